@@ -1,17 +1,42 @@
 #pragma once
 
 #include <list>
+#include <vector>
 #include <mutex>
 #include <functional>
 #include <atomic>
+#include <type_traits>
 
 #include <asyncpp/common.hpp>
 #include <asyncpp/timeout.hpp>
 #include <asyncpp/adv_semaphore.hpp>
+#include <asyncpp/sojourn.hpp>
+#include <asyncpp/codel.hpp>
 
 namespace asyncpp
 {
-    template<typename _Item, bool _InterProcess = false, typename _Queue=std::list<_Item>>
+    //the bytes an item accounts for in a byte bounded adv_queue,
+    //specialize it for your own types. containers count their elements
+    template<typename _Item, typename = void>
+    struct item_bytes
+    {
+        static uint64_t of(const _Item &) {
+            return sizeof(_Item);
+        }
+    };
+    template<typename _Item>
+    struct item_bytes<_Item, std::void_t<typename _Item::value_type, decltype(std::declval<const _Item &>().size())>>
+    {
+        static uint64_t of(const _Item & item) {
+            return (uint64_t)item.size() * sizeof(typename _Item::value_type);
+        }
+    };
+
+    template<
+        typename _Item,
+        bool _InterProcess = false,
+        typename _Queue = std::list<_Item>,
+        template<bool> typename _Policy = sync_policy>
     class adv_queue
     {
     public:
@@ -19,8 +44,11 @@ namespace asyncpp
         adv_queue(const adv_queue &) = delete;
         adv_queue & operator = (const adv_queue &) = delete;
     public:
-        using mutex_t = asyncpp::mutex<_InterProcess>;
-        using lock_t = std::unique_lock<std::mutex>;
+        using item_type = _Item;
+        using mutex_t = typename _Policy<_InterProcess>::mutex_t;
+        using lock_t = typename _Policy<_InterProcess>::lock_t;
+        using traits_t = sojourn_traits<_Item, _Queue>;
+        using size_fn_t = std::function<uint64_t(const _Item &)>;
     public:
         //manipulating functions:
         result_code enable(uint32_t capacity) {
@@ -28,19 +56,84 @@ namespace asyncpp
                 return result_code::INVALID_ARGUMENTS;
             }
             lock_t lock(mMutex);
-            mQueue.clear();
-            mCapacity = capacity;
-            mSemC.set_value(mCapacity);
-            mSemP.set_value(0);
-            mSemC.enable();
-            mSemP.enable();
+            mByteMode = false;
+            mItemCap = 0;
+            mSizeFn = nullptr;
+            _enable(capacity);
+            return result_code::SUCCEED;
+        }
+
+        //byte bounded mode: capacity, change_capacity(), fill() and drain()
+        //count the bytes given by size_fn, or by item_bytes<_Item> without
+        //one, so pushes block once the items queued hold that many bytes.
+        //max_items caps the item count as well, 0 for no cap.
+        //process shared queues can't take a size_fn.
+        result_code enable_bytes(uint64_t bytes, uint32_t max_items = 0, const size_fn_t & size_fn = nullptr) {
+            if (bytes == 0) {
+                return result_code::INVALID_ARGUMENTS;
+            }
+            if (_InterProcess && size_fn != nullptr) {
+                return result_code::INVALID_ARGUMENTS;
+            }
+            lock_t lock(mMutex);
+            mByteMode = true;
+            mItemCap = max_items;
+            mSizeFn = size_fn;
+            mSemN.set_value(max_items);
+            mSemB.set_value(0);
+            //poppers wait on mSemB only for bytes a pusher is about to
+            //release, a fill() waiting for its level must not hold them back
+            mSemB.set_fairness(decltype(mSemB)::FIRST_FIT, UINT32_MAX);
+            mSemN.enable();
+            mSemB.enable();
+            _enable(bytes);
             return result_code::SUCCEED;
         }
 
         void disable() {
             lock_t lock(mMutex);
+            mEnabled = false;
             mSemC.disable();
             mSemP.disable();
+            mSemN.disable();
+            mSemB.disable();
+        }
+
+        //CoDel active queue management, needs a container of stamped items
+        //and is configured while the queue is disabled.
+        //dropped items go to on_drop, called by the popping thread after the
+        //queue lock is released. process shared queues just destroy them.
+        result_code enable_aqm(
+                aqm_mode mode,
+                clock::duration target,
+                clock::duration interval,
+                const std::function<void(_Item &&)> & on_drop = nullptr) {
+            static_assert(traits_t::tracked, "the container does not hold stamped items");
+            if (target <= clock::duration::zero() || interval <= clock::duration::zero()) {
+                return result_code::INVALID_ARGUMENTS;
+            }
+            if (_InterProcess && on_drop != nullptr) {
+                return result_code::INVALID_ARGUMENTS;
+            }
+            lock_t lock(mMutex);
+            if (mEnabled) {
+                return result_code::INCORRECT_STATE;
+            }
+            mCodel.configure(target, interval);
+            mAqmMode = mode;
+            mOnDrop = on_drop;
+            mAqmEnabled = true;
+            return result_code::SUCCEED;
+        }
+
+        result_code disable_aqm() {
+            lock_t lock(mMutex);
+            if (mEnabled) {
+                return result_code::INCORRECT_STATE;
+            }
+            mAqmEnabled = false;
+            mOnDrop = nullptr;
+            return result_code::SUCCEED;
         }
 
         //don't clear when queue still in use
@@ -50,15 +143,52 @@ namespace asyncpp
             mQueue.clear();
         }
 
-        uint32_t get_capacity() {
+        //in bytes for a byte bounded queue
+        uint64_t get_capacity() {
             return mCapacity;
         }
+        bool is_byte_bounded() const {
+            return mByteMode;
+        }
+        //bytes held by the queued items, byte bounded queues only
+        uint64_t get_bytes() const {
+            return mBytes.load(std::memory_order_relaxed);
+        }
 
         uint32_t get_size() {
             lock_t lock(mMutex);
             return mQueue.size();
         }
 
+        //load statistics, see capacity_controller
+        clock::duration get_push_wait_time() const {
+            return mSemC.get_wait_time();
+        }
+        clock::duration get_pop_wait_time() const {
+            return mSemP.get_wait_time();
+        }
+        uint64_t get_pop_count() const {
+            return mPopCount.load(std::memory_order_relaxed);
+        }
+
+        //time items spent queued, in nanoseconds.
+        //only for queues whose container holds stamped<_Item>
+        latency_histogram & get_sojourn() {
+            static_assert(traits_t::tracked, "the container does not hold stamped items");
+            return mSojourn;
+        }
+
+        //select support: readiness to pop
+        result_code attach(wait_node & node) {
+            return mSemP.attach(node);
+        }
+        void detach(wait_node & node) {
+            mSemP.detach(node);
+        }
+        bool ready() const {
+            return mSemP.ready();
+        }
+
         result_code block_pushing(const timeout & to = timeout()) {
             lock_t lock(mMutex);
             return mSemC.block(nullptr, to);
@@ -90,12 +220,32 @@ namespace asyncpp
         }
 
         result_code fill(const timeout & to = timeout()) {
+            return fill(mCapacity, to);
+        }
+        //holds poppers back until level items, or bytes, are queued.
+        //items rarely add up to the byte capacity exactly, so byte bounded
+        //queues usually fill to a level below it
+        result_code fill(uint64_t level, const timeout & to = timeout()) {
             lock_t lock(mMutex);
+            if (level == 0 || level > mCapacity) {
+                return result_code::INVALID_ARGUMENTS;
+            }
             result_code res = result_code::SUCCEED;
             if ((res = mSemC.unblock()) != result_code::SUCCEED) {
                 return res;
             }
-            if ((res = mSemP.block_and_reserve(mCapacity, nullptr, to)) != result_code::SUCCEED) {
+            if (!mByteMode) {
+                return mSemP.block_and_reserve((uint32_t)level, nullptr, to);
+            }
+            bool held = mSemP.blocked_by_this();
+            if ((res = mSemP.block(nullptr, to)) != result_code::SUCCEED) {
+                return res;
+            }
+            //gives back a block taken here, as block_and_reserve does
+            if ((res = mSemB.do_operations(decltype(mSemB)::RESERVE, level, nullptr, to)) != result_code::SUCCEED) {
+                if (!held) {
+                    mSemP.unblock();
+                }
                 return res;
             }
             return result_code::SUCCEED;
@@ -113,13 +263,14 @@ namespace asyncpp
             return result_code::SUCCEED;
         }
 
-        result_code change_capacity(uint32_t capacity, const timeout & to = timeout()) {
+        result_code change_capacity(uint64_t capacity, const timeout & to = timeout()) {
             lock_t lock(mMutex);
             if (capacity == mCapacity) {
                 return result_code::SUCCEED;
             }
             result_code res = result_code::SUCCEED;
             if (capacity < mCapacity) {
+                //a shrink that fails gives back only the block it took itself
                 if ((res = mSemC.block_and_acquire(mCapacity - capacity, nullptr, to)) != result_code::SUCCEED) {
                     return res;
                 }
@@ -137,7 +288,13 @@ namespace asyncpp
         //data functions
         result_code push(const _Item & item, const timeout & to = timeout()) {
             result_code res = result_code::SUCCEED;
-            if ((res = mSemC.acquire([&]{ mQueue.emplace_back(item); }, to)) != result_code::SUCCEED) {
+            if (_reject()) {
+                return result_code::REJECTED;
+            }
+            if (mByteMode) {
+                return _push_bytes(item, &to);
+            }
+            if ((res = mSemC.acquire([&]{ traits_t::put(mQueue, item); }, to)) != result_code::SUCCEED) {
                 return res;
             }
             mSemP.release();
@@ -145,7 +302,13 @@ namespace asyncpp
         }
         result_code push(_Item && item, const timeout & to = timeout()) {
             result_code res = result_code::SUCCEED;
-            if ((res = mSemC.acquire([&]{ mQueue.emplace_back(std::move(item)); }, to)) != result_code::SUCCEED) {
+            if (_reject()) {
+                return result_code::REJECTED;
+            }
+            if (mByteMode) {
+                return _push_bytes(std::move(item), &to);
+            }
+            if ((res = mSemC.acquire([&]{ traits_t::put(mQueue, std::move(item)); }, to)) != result_code::SUCCEED) {
                 return res;
             }
             mSemP.release();
@@ -154,7 +317,13 @@ namespace asyncpp
 
         result_code try_push(const _Item & item) {
             result_code res = result_code::SUCCEED;
-            if ((res = mSemC.try_acquire([&]{ mQueue.emplace_back(item); })) != result_code::SUCCEED) {
+            if (_reject()) {
+                return result_code::REJECTED;
+            }
+            if (mByteMode) {
+                return _push_bytes(item, nullptr);
+            }
+            if ((res = mSemC.try_acquire([&]{ traits_t::put(mQueue, item); })) != result_code::SUCCEED) {
                 return res;
             }
             mSemP.release();
@@ -162,7 +331,13 @@ namespace asyncpp
         }
         result_code try_push(_Item && item) {
             result_code res = result_code::SUCCEED;
-            if ((res = mSemC.try_acquire([&]{ mQueue.emplace_back(std::move(item)); })) != result_code::SUCCEED) {
+            if (_reject()) {
+                return result_code::REJECTED;
+            }
+            if (mByteMode) {
+                return _push_bytes(std::move(item), nullptr);
+            }
+            if ((res = mSemC.try_acquire([&]{ traits_t::put(mQueue, std::move(item)); })) != result_code::SUCCEED) {
                 return res;
             }
             mSemP.release();
@@ -174,11 +349,7 @@ namespace asyncpp
             if ((res = mSemP.acquire(nullptr, to)) != result_code::SUCCEED) {
                 return res;
             }
-            auto p = [&] {
-                item = std::move(mQueue.front());
-                mQueue.pop_front();
-            };
-            mSemC.release(p);
+            _finish_pop(item);
             return res;
         }
         result_code try_pop(_Item & item) {
@@ -186,20 +357,207 @@ namespace asyncpp
             if ((res = mSemP.try_acquire()) != result_code::SUCCEED) {
                 return res;
             }
-            auto p = [&] {
-                item = std::move(mQueue.front());
-                mQueue.pop_front();
-            };
-            mSemC.release(p);
+            _finish_pop(item);
+            return res;
+        }
+
+        //waits until min_items are queued or linger has passed, then takes
+        //up to max_items at once and appends them to out. after linger it
+        //takes what there is, UNAVAILABLE_OR_TIMEOUT only for nothing
+        result_code pop_batch(
+                std::vector<_Item> & out,
+                uint32_t min_items,
+                uint32_t max_items,
+                const timeout & linger = timeout()) {
+            uint32_t count = 0;
+            result_code res = mSemP.acquire_batch(min_items, max_items, count, nullptr, linger);
+            if (res != result_code::SUCCEED) {
+                return res;
+            }
+            _finish_batch(out, count);
+            return res;
+        }
+        //takes up to max_items of what is queued, never waits
+        result_code try_pop_batch(std::vector<_Item> & out, uint32_t max_items) {
+            uint32_t count = 0;
+            result_code res = mSemP.try_acquire_batch(max_items, count);
+            if (res != result_code::SUCCEED) {
+                return res;
+            }
+            _finish_batch(out, count);
             return res;
         }
 
     private:
+        void _finish_batch(std::vector<_Item> & out, uint32_t count) {
+            std::size_t first = out.size();
+            out.resize(first + count);
+            std::size_t next = first;
+            _finish_pops(count, [&]() -> _Item & {
+                return out[next++];
+            });
+        }
+
+        void _enable(uint64_t capacity) {
+            mQueue.clear();
+            mCapacity = capacity;
+            mBytes = 0;
+            mSemC.set_value(capacity);
+            mSemP.set_value(0);
+            mCodel.reset();
+            mRejectCredits = 0;
+            mSemC.enable();
+            mSemP.enable();
+            mEnabled = true;
+        }
+
+        uint64_t _bytes(const _Item & item) const {
+            uint64_t bytes = mSizeFn != nullptr ? mSizeFn(item) : item_bytes<_Item>::of(item);
+            //an empty item still takes a place
+            return bytes > 0 ? bytes : 1;
+        }
+
+        //a push takes an item slot if capped, then its bytes while the
+        //item goes in, then makes both the item and its bytes poppable.
+        //to is null for try_push
+        template<typename _Ref>
+        result_code _push_bytes(_Ref && item, const timeout * to) {
+            uint64_t bytes = _bytes(item);
+            if (bytes > mCapacity) {
+                return result_code::INVALID_ARGUMENTS;
+            }
+            result_code res = result_code::SUCCEED;
+            if (mItemCap > 0) {
+                res = to != nullptr ? mSemN.acquire(nullptr, *to) : mSemN.try_acquire();
+                if (res != result_code::SUCCEED) {
+                    return res;
+                }
+            }
+            auto put = [&] {
+                traits_t::put(mQueue, std::forward<_Ref>(item));
+                mBytes.fetch_add(bytes, std::memory_order_relaxed);
+            };
+            res = to != nullptr ? mSemC.acquire(bytes, put, *to) : mSemC.try_acquire(bytes, put);
+            if (res != result_code::SUCCEED) {
+                if (mItemCap > 0) {
+                    mSemN.release();
+                }
+                return res;
+            }
+            mSemB.release(bytes);
+            mSemP.release();
+            return res;
+        }
+
+        //in reject mode every drop CoDel asks for refuses one push instead
+        bool _reject() {
+            if (!traits_t::tracked || !mAqmEnabled || mAqmMode != aqm_mode::AQM_REJECT_PUSH) {
+                return false;
+            }
+            uint32_t credits = mRejectCredits.load(std::memory_order_relaxed);
+            while (credits > 0) {
+                if (mRejectCredits.compare_exchange_weak(credits, credits - 1, std::memory_order_relaxed)) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        //runs under mSemC's lock with one item acquired from mSemP.
+        //every further item dropped takes one more from mSemP, counted in extra
+        void _take(_Item & item, uint32_t & extra, std::vector<_Item> & dropped) {
+            clock::duration sojourn = traits_t::take(mQueue, item, mSojourn);
+            if constexpr (traits_t::tracked) {
+                if (!mAqmEnabled) {
+                    return;
+                }
+                time_point now = clock::now();
+                while (mCodel.should_drop(now, sojourn, mQueue.empty())) {
+                    if (mAqmMode == aqm_mode::AQM_REJECT_PUSH) {
+                        mRejectCredits.fetch_add(1, std::memory_order_relaxed);
+                        return;
+                    }
+                    if (mSemP.try_acquire() != result_code::SUCCEED) {
+                        return;
+                    }
+                    dropped.emplace_back(std::move(item));
+                    ++extra;
+                    sojourn = traits_t::take(mQueue, item, mSojourn);
+                }
+                if (!mCodel.dropping()) {
+                    mRejectCredits.store(0, std::memory_order_relaxed);
+                }
+            }
+        }
+
+        void _finish_pop(_Item & item) {
+            _finish_pops(1, [&]() -> _Item & {
+                return item;
+            });
+        }
+        //takes count items acquired from mSemP, each into the one next() returns
+        template<typename _Next>
+        void _finish_pops(uint32_t count, const _Next & next) {
+            uint32_t extra = 0;
+            std::vector<_Item> dropped;
+            if (!mByteMode) {
+                mSemC.release(count, [&] {
+                    for (uint32_t i = 0; i < count; ++i) {
+                        _take(next(), extra, dropped);
+                    }
+                });
+                if (extra > 0) {
+                    mSemC.release(extra);
+                }
+            } else {
+                //the bytes are only known once the items are out
+                uint64_t bytes = 0;
+                mSemC.do_operations(decltype(mSemC)::NONE, 0, [&] {
+                    for (uint32_t i = 0; i < count; ++i) {
+                        _Item & item = next();
+                        _take(item, extra, dropped);
+                        bytes += _bytes(item);
+                    }
+                    for (auto & d : dropped) {
+                        bytes += _bytes(d);
+                    }
+                    mBytes.fetch_sub(bytes, std::memory_order_relaxed);
+                });
+                mSemC.release(bytes);
+                //the pusher of an item may not have released its bytes yet
+                mSemB.acquire(bytes);
+                if (mItemCap > 0) {
+                    mSemN.release(count + extra);
+                }
+            }
+            mPopCount.fetch_add(count, std::memory_order_relaxed);
+            if (mOnDrop != nullptr) {
+                for (auto & d : dropped) {
+                    mOnDrop(std::move(d));
+                }
+            }
+        }
     private:
         mutex_t mMutex;
-        std::atomic<uint32_t> mCapacity = 0;
-        adv_semaphore<_InterProcess> mSemP;
-        adv_semaphore<_InterProcess> mSemC;
+        std::atomic<uint64_t> mCapacity = 0;
+        adv_semaphore<_InterProcess, uint32_t, _Policy> mSemP;
+        //free items, or free bytes in byte mode
+        adv_semaphore<_InterProcess, uint64_t, _Policy> mSemC;
+        //byte mode only: free item slots under the cap and queued bytes
+        adv_semaphore<_InterProcess, uint32_t, _Policy> mSemN;
+        adv_semaphore<_InterProcess, uint64_t, _Policy> mSemB;
+        bool mByteMode = false;
+        uint32_t mItemCap = 0;
+        std::atomic<uint64_t> mBytes = 0;
+        size_fn_t mSizeFn;
         _Queue mQueue;
+        typename traits_t::histogram_t mSojourn;
+        bool mEnabled = false;
+        std::atomic<bool> mAqmEnabled = false;
+        aqm_mode mAqmMode = aqm_mode::AQM_DROP_HEAD;
+        std::atomic<uint32_t> mRejectCredits = 0;
+        std::atomic<uint64_t> mPopCount = 0;
+        codel mCodel;
+        std::function<void(_Item &&)> mOnDrop;
     };
 }
@@ -10,23 +10,25 @@
 #include "asyncpp/common.hpp"
 #include "asyncpp/timeout.hpp"
 #include "asyncpp/pthread_wrapper.hpp"
+#include "asyncpp/wait_list.hpp"
 
 namespace asyncpp
 {
     template<
         bool _InterProcess = false,
         typename _Counter = uint32_t, 
-        typename = typename std::enable_if<std::is_unsigned<_Counter>::value>::type>
+        template<bool> typename _Policy = sync_policy>
     class adv_semaphore
     {
+        static_assert(std::is_unsigned<_Counter>::value, "counter must be unsigned");
     public:
         adv_semaphore() = default;
         adv_semaphore(const adv_semaphore &) = delete;
         adv_semaphore & operator = (const adv_semaphore &) = delete;
     public:
-        using mutex_t = asyncpp::mutex<_InterProcess>;
-        using cond_t = asyncpp::condition_variable<_InterProcess>;
-        using lock_t = std::unique_lock<std::mutex>;
+        using mutex_t = typename _Policy<_InterProcess>::mutex_t;
+        using cond_t = typename _Policy<_InterProcess>::cond_t;
+        using lock_t = typename _Policy<_InterProcess>::lock_t;
         using proc_t = std::function<void()>;
         enum opflag {
             NONE = 0x00,
@@ -36,6 +38,26 @@ namespace asyncpp
             ACQUIRE = 0x08,
             RELEASE = 0x10,
         };
+        //in which order blocked threads are served, process local only
+        enum order {
+            FIFO = 0,
+            THREAD_PRIORITY,
+        };
+        //how weighted requests share the permits.
+        //STRICT serves requests in order, one that does not fit yet holds
+        //back everyone behind it. FIRST_FIT lets smaller requests pass it,
+        //but only max_bypass times, then it is served before anyone else.
+        //the process shared flavour has no queue: a request that does not
+        //fit claims the permits it waits for, right away or after max_bypass
+        //fruitless wake ups, and one claim is held at a time.
+        //process locally FIRST_FIT also lets a request take back permits
+        //just handed to a waiter that has not run yet, as a pass. STRICT
+        //never does, so a thread releasing and acquiring again in a loop
+        //while others wait goes to sleep once per permit.
+        enum fairness {
+            STRICT = 0,
+            FIRST_FIT,
+        };
     public:
         result_code set_value(_Counter value) {
             lock_t lock(mMutex);
@@ -45,10 +67,39 @@ namespace asyncpp
             mValue = value;
             return result_code::SUCCEED;
         }
+        result_code set_order(order o) {
+            lock_t lock(mMutex);
+            if (mEnabled) {
+                return result_code::INCORRECT_STATE;
+            }
+            mOrder = o;
+            return result_code::SUCCEED;
+        }
+        result_code set_fairness(fairness f, uint32_t max_bypass = 16) {
+            lock_t lock(mMutex);
+            if (mEnabled) {
+                return result_code::INCORRECT_STATE;
+            }
+            mFairness = f;
+            mMaxBypass = max_bypass;
+            return result_code::SUCCEED;
+        }
+        //total time threads spent parked in acquire, including the waits
+        //still going on, for load monitoring.
+        //waits of block_and_acquire are left out
+        clock::duration get_wait_time() const {
+            lock_t lock(mMutex);
+            return mWaitTime + mParked * clock::now().time_since_epoch() - mParkedSince;
+        }
         _Counter get_value() const {
             lock_t lock(mMutex);
             return mValue;
         }
+        //times a parked thread woke up, for diagnostics
+        uint64_t get_wakeups() const {
+            lock_t lock(mMutex);
+            return mWakeups;
+        }
         result_code enable() {
             lock_t lock(mMutex);
             mEnabled = true;
@@ -62,11 +113,39 @@ namespace asyncpp
             }
             mEnabled = false;
             mBlockerID = std::thread::id();
+            mClaimerID = std::thread::id();
+            mClaim = 0;
             mCondBlock.notify_all();
             mCond.notify_all();
+            while (mHead != nullptr) {
+                _grant(mHead, waiter::CANCELLED);
+            }
+            mWatchers.notify_all();
             return result_code::SUCCEED;
         }
 
+        //select support, in-process only.
+        //watchers are called back whenever an acquire may have become possible
+        result_code attach(wait_node & node) {
+            static_assert(!_InterProcess, "watchers are process local");
+            lock_t lock(mMutex);
+            mWatchers.attach(&node);
+            return result_code::SUCCEED;
+        }
+        void detach(wait_node & node) {
+            lock_t lock(mMutex);
+            mWatchers.detach(&node);
+        }
+        //whether acquire() would return without blocking, disabled counts as ready
+        bool ready() const {
+            lock_t lock(mMutex);
+            return !mEnabled || (mValue > 0 && !_blocked_by_others());
+        }
+        bool blocked_by_this() const {
+            lock_t lock(mMutex);
+            return _blocked_by_this();
+        }
+
         result_code do_operations(
                 opflag flags, 
                 _Counter count,
@@ -94,6 +173,77 @@ namespace asyncpp
         result_code try_reserve(const proc_t & proc = nullptr) {
             return _try_operations(opflag::RESERVE, 1, proc);
         }
+        //weighted flavours, take count permits at once
+        result_code acquire(_Counter count, const proc_t & proc = nullptr, const timeout & to = timeout()) {
+            return _do_operations(opflag::ACQUIRE, count, proc, to);
+        }
+        result_code try_acquire(_Counter count, const proc_t & proc = nullptr) {
+            return _try_operations(opflag::ACQUIRE, count, proc);
+        }
+        //takes between min and max permits, taken tells how many.
+        //waits for min until to, then takes whatever else is free up to max
+        //under the same lock. when to passes with fewer than min free, those
+        //are taken, UNAVAILABLE_OR_TIMEOUT only when there is none
+        result_code acquire_batch(
+                _Counter min,
+                _Counter max,
+                _Counter & taken,
+                const proc_t & proc = nullptr,
+                const timeout & to = timeout()) {
+            taken = 0;
+            if (min == 0 || max < min) {
+                return result_code::INVALID_ARGUMENTS;
+            }
+            lock_t lock(mMutex);
+            if (!mEnabled) {
+                return result_code::DISABLED;
+            }
+            if (_free() < min) {
+                lock.unlock();
+                result_code res = _do_operations(opflag::ACQUIRE, min, nullptr, to);
+                lock.lock();
+                if (res == result_code::SUCCEED) {
+                    taken = min;
+                } else if (res != result_code::UNAVAILABLE_OR_TIMEOUT) {
+                    return res;
+                }
+            }
+            _Counter more = _free();
+            more = more < max - taken ? more : max - taken;
+            mValue -= more;
+            taken += more;
+            if (taken == 0) {
+                return result_code::UNAVAILABLE_OR_TIMEOUT;
+            }
+            if (proc != nullptr) {
+                proc();
+            }
+            return result_code::SUCCEED;
+        }
+        //takes whatever is free up to max without waiting or queueing
+        result_code try_acquire_batch(
+                _Counter max,
+                _Counter & taken,
+                const proc_t & proc = nullptr) {
+            taken = 0;
+            if (max == 0) {
+                return result_code::INVALID_ARGUMENTS;
+            }
+            lock_t lock(mMutex);
+            if (!mEnabled) {
+                return result_code::DISABLED;
+            }
+            _Counter more = _free();
+            taken = more < max ? more : max;
+            if (taken == 0) {
+                return result_code::UNAVAILABLE_OR_TIMEOUT;
+            }
+            mValue -= taken;
+            if (proc != nullptr) {
+                proc();
+            }
+            return result_code::SUCCEED;
+        }
 
         result_code block(const proc_t & proc = nullptr, const timeout & to = timeout()) {
             return _do_operations(opflag::PREV_BLOCK, 0, proc, to);
@@ -153,25 +303,28 @@ namespace asyncpp
             return (f & opflag::RELEASE) != 0;
         }
 
-        inline bool _blocked() {
+        inline bool _blocked() const {
             return mBlockerID != std::thread::id();
         }
 
-        inline bool _blocked_by_this() {
+        inline bool _blocked_by_this() const {
             return mBlockerID == std::this_thread::get_id();
         }
 
-        inline bool _blocked_by_others() {
+        inline bool _blocked_by_others() const {
             return _blocked() && !_blocked_by_this();
         }
 
         result_code _wait(lock_t & lock, cond_t & cond, const timeout & to) {
             if (to.has_value()) {
-                if (cond.wait_until(lock, to.value()) == std::cv_status::timeout) {
+                std::cv_status status = cond.wait_until(lock, to.value());
+                ++mWakeups;
+                if (status == std::cv_status::timeout) {
                     return result_code::UNAVAILABLE_OR_TIMEOUT;
                 } 
             } else {
                 cond.wait(lock);
+                ++mWakeups;
             }
             return result_code::SUCCEED;
         }
@@ -190,26 +343,362 @@ namespace asyncpp
             return result_code::SUCCEED;
         }
 
-        result_code _wait_value(lock_t & lock, _Counter value, const timeout & to) {
+        //wait time accounting, under mMutex
+        time_point _park() {
+            time_point now = clock::now();
+            ++mParked;
+            mParkedSince += now.time_since_epoch();
+            return now;
+        }
+        void _unpark(time_point since) {
+            --mParked;
+            mParkedSince -= since.time_since_epoch();
+            mWaitTime += clock::now() - since;
+        }
+
+        //process shared claims, see fairness. permits claimed by another
+        //thread are left to it, except for the blocker
+        inline bool _fits(_Counter value) const {
+            bool held = mClaimerID != std::thread::id()
+                && mClaimerID != std::this_thread::get_id()
+                && !_blocked_by_this();
+            return mValue >= value && (!held || mValue - value >= mClaim);
+        }
+        //permits that may be taken right now without passing a queued
+        //waiter, a claim or a block, under mMutex
+        _Counter _free() const {
+            if (!mEnabled || _blocked_by_others()) {
+                return 0;
+            }
+            if constexpr (_InterProcess) {
+                bool held = mClaimerID != std::thread::id()
+                    && mClaimerID != std::this_thread::get_id()
+                    && !_blocked_by_this();
+                return !held ? mValue : (mValue > mClaim ? mValue - mClaim : 0);
+            } else {
+                return mHead == nullptr || _blocked_by_this() ? mValue : 0;
+            }
+        }
+        void _unclaim() {
+            if (mClaimerID == std::this_thread::get_id()) {
+                mClaimerID = std::thread::id();
+                mClaim = 0;
+                mCond.notify_all();
+            }
+        }
+
+        result_code _wait_value(lock_t & lock, _Counter value, bool account, const timeout & to) {
             if (_blocked_by_others()) {
                 return result_code::BLOCKED;
             }
             result_code res = result_code::SUCCEED;
-            while (mValue < value) {
+            uint32_t wakeups = 0;
+            uint32_t patience = mFairness == fairness::STRICT ? 0 : mMaxBypass;
+            while (!_fits(value)) {
+                if (wakeups++ >= patience && mClaimerID == std::thread::id()) {
+                    mClaimerID = std::this_thread::get_id();
+                    mClaim = value;
+                }
+                time_point t0 = account ? _park() : time_point();
                 res = _wait(lock, mCond, to);
-                if (res != result_code::SUCCEED) {
-                    return res;
+                if (account) {
+                    _unpark(t0);
                 }
-                if (!mEnabled) {
-                    return result_code::DISABLED;
+                if (res == result_code::SUCCEED && !mEnabled) {
+                    res = result_code::DISABLED;
                 }
-                if (_blocked_by_others()) {
-                    return result_code::BLOCKED;
+                if (res == result_code::SUCCEED && _blocked_by_others()) {
+                    res = result_code::BLOCKED;
+                }
+                if (res != result_code::SUCCEED) {
+                    _unclaim();
+                    return res;
                 }
             }
+            //taking the claimed permits leaves the others where they were
+            if (mClaimerID == std::this_thread::get_id()) {
+                mClaimerID = std::thread::id();
+                mClaim = 0;
+            }
             return result_code::SUCCEED;
         }
         
+        //handoff waiters, only used by process local semaphores.
+        //a waiter lives on the waiting thread's stack and is granted in place
+        //so a release wakes exactly the threads it can satisfy.
+        struct waiter
+        {
+            enum state_t {
+                WAITING = 0,
+                GRANTED,
+                CANCELLED,
+            };
+            waiter * prev = nullptr;
+            waiter * next = nullptr;
+            std::thread::id id;
+            opflag kind = opflag::NONE;
+            _Counter count = 0;
+            //times a later request was served first, see fairness
+            uint32_t bypassed = 0;
+            int prio = 0;
+            state_t state = WAITING;
+            //granted but not run yet, on mGranted, see _barge()
+            bool unclaimed = false;
+            cond_t cond;
+        };
+
+        static int _thread_prio() {
+            int policy = 0;
+            sched_param param = {};
+            if (pthread_getschedparam(pthread_self(), &policy, &param) != 0) {
+                return 0;
+            }
+            return param.sched_priority;
+        }
+
+        inline bool _blocked_by_other_than(const waiter * w) const {
+            return _blocked() && mBlockerID != w->id;
+        }
+
+        void _enqueue(waiter * w) {
+            waiter * after = mTail;
+            if (mOrder == order::THREAD_PRIORITY) {
+                w->prio = _thread_prio();
+                while (after != nullptr && after->prio < w->prio) {
+                    after = after->prev;
+                }
+            }
+            w->prev = after;
+            w->next = after != nullptr ? after->next : mHead;
+            if (w->next != nullptr) {
+                w->next->prev = w;
+            } else {
+                mTail = w;
+            }
+            if (after != nullptr) {
+                after->next = w;
+            } else {
+                mHead = w;
+            }
+        }
+
+        void _enqueue_front(waiter * w) {
+            w->prev = nullptr;
+            w->next = mHead;
+            if (mHead != nullptr) {
+                mHead->prev = w;
+            } else {
+                mTail = w;
+            }
+            mHead = w;
+        }
+
+        void _remove(waiter * w) {
+            if (w->prev != nullptr) {
+                w->prev->next = w->next;
+            } else {
+                mHead = w->next;
+            }
+            if (w->next != nullptr) {
+                w->next->prev = w->prev;
+            } else {
+                mTail = w->prev;
+            }
+            w->prev = w->next = nullptr;
+        }
+
+        void _grant(waiter * w, typename waiter::state_t state) {
+            _remove(w);
+            w->state = state;
+            //the waiter may return as soon as the lock is dropped,
+            //so it is notified while the lock is still held
+            w->cond.notify_one();
+        }
+
+        void _link_granted(waiter * w) {
+            w->unclaimed = true;
+            w->prev = nullptr;
+            w->next = mGranted;
+            if (mGranted != nullptr) {
+                mGranted->prev = w;
+            }
+            mGranted = w;
+        }
+        void _unlink_granted(waiter * w) {
+            if (w->prev != nullptr) {
+                w->prev->next = w->next;
+            } else {
+                mGranted = w->next;
+            }
+            if (w->next != nullptr) {
+                w->next->prev = w->prev;
+            }
+            w->prev = w->next = nullptr;
+            w->unclaimed = false;
+        }
+
+        //FIRST_FIT: a request that would queue behind a waiter whose permits
+        //were handed over but who has not run yet takes them back, saving
+        //the caller a sleep. the waiter goes back to the head of the queue,
+        //charged a pass, and sleeps on
+        bool _barge(opflag flag, _Counter count) {
+            if (mFairness != fairness::FIRST_FIT || !_has_acquire_flag(flag) || _blocked()) {
+                return false;
+            }
+            for (waiter * g = mGranted; g != nullptr; g = g->next) {
+                if (g->bypassed >= mMaxBypass || mValue + g->count < count) {
+                    continue;
+                }
+                _unlink_granted(g);
+                g->state = waiter::WAITING;
+                ++g->bypassed;
+                mValue += g->count;
+                _enqueue_front(g);
+                mValue -= count;
+                //what is left may serve the queue
+                _dispatch();
+                return true;
+            }
+            return false;
+        }
+
+        //hands the block and permits to waiters in queue order.
+        //while blocked only the blocker's waiters are served, otherwise
+        //a value waiter that cannot be satisfied yet is passed only as far
+        //as the fairness allows. the fairness holds back value waiters
+        //only: a free block always goes to the first block waiter.
+        void _dispatch() {
+            waiter * stuck = nullptr;
+            bool held = false;
+            for (waiter * w = mHead; w != nullptr; ) {
+                waiter * next = w->next;
+                if (_blocked_by_other_than(w)) {
+                    w = next;
+                    continue;
+                }
+                if (w->kind == opflag::PREV_BLOCK) {
+                    mBlockerID = w->id;
+                    _grant(w, waiter::GRANTED);
+                    w = next;
+                    continue;
+                }
+                if (held) {
+                    w = next;
+                    continue;
+                }
+                if (mValue < w->count) {
+                    if (mFairness == fairness::STRICT) {
+                        held = true;
+                    } else if (stuck == nullptr) {
+                        stuck = w;
+                    }
+                    w = next;
+                    continue;
+                }
+                if (stuck != nullptr) {
+                    if (stuck->bypassed >= mMaxBypass) {
+                        held = true;
+                        w = next;
+                        continue;
+                    }
+                    ++stuck->bypassed;
+                }
+                _grant(w, waiter::GRANTED);
+                if (_has_acquire_flag(w->kind)) {
+                    mValue -= w->count;
+                    if (mFairness == fairness::FIRST_FIT) {
+                        _link_granted(w);
+                    }
+                }
+                w = next;
+            }
+        }
+
+        result_code _wait_turn(lock_t & lock, opflag kind, _Counter count, const timeout & to) {
+            waiter w;
+            w.id = std::this_thread::get_id();
+            w.kind = kind;
+            w.count = count;
+            _enqueue(&w);
+            //time parked for permits is accounted, see get_wait_time().
+            //a blocker draining permits is not a starved acquirer
+            bool account = _has_acquire_flag(kind) && !_blocked_by_this();
+            time_point t0 = account ? _park() : time_point();
+            while (w.state == waiter::WAITING) {
+                if (to.has_value()) {
+                    std::cv_status status = w.cond.wait_until(lock, to.value());
+                    ++mWakeups;
+                    if (status == std::cv_status::timeout && w.state == waiter::WAITING) {
+                        if (account) {
+                            _unpark(t0);
+                        }
+                        _remove(&w);
+                        //a waiter at the head may have held back the others
+                        _dispatch();
+                        return result_code::UNAVAILABLE_OR_TIMEOUT;
+                    }
+                } else {
+                    w.cond.wait(lock);
+                    ++mWakeups;
+                }
+            }
+            if (w.unclaimed) {
+                _unlink_granted(&w);
+            }
+            if (account) {
+                _unpark(t0);
+            }
+            return w.state == waiter::GRANTED ? result_code::SUCCEED : result_code::DISABLED;
+        }
+
+        //whether a new value request may be served right now, passing
+        //the queued ones only as far as the fairness allows
+        inline bool _can_take(_Counter count) const {
+            if (mValue < count) {
+                return false;
+            }
+            if (mHead == nullptr || _blocked_by_this()) {
+                return true;
+            }
+            return mFairness == fairness::FIRST_FIT && mHead->bypassed < mMaxBypass;
+        }
+        //after _can_take(), charges passing the queue to its head
+        inline void _take(opflag flag, _Counter count) {
+            if (_has_acquire_flag(flag)) {
+                mValue -= count;
+            }
+            if (mHead != nullptr && !_blocked_by_this()) {
+                ++mHead->bypassed;
+            }
+        }
+
+        void _on_released() {
+            if constexpr (_InterProcess) {
+                mCond.notify_all();
+            } else {
+                _dispatch();
+            }
+            mWatchers.notify_all();
+        }
+
+        void _on_unblocked() {
+            if constexpr (_InterProcess) {
+                mCondBlock.notify_all();
+            } else {
+                _dispatch();
+            }
+            mWatchers.notify_all();
+        }
+
+        //a block taken by a call that then failed to get its value is given
+        //back, one held before the call is kept
+        void _undo_block(bool blocked) {
+            if (blocked && _blocked_by_this()) {
+                mBlockerID = std::thread::id();
+                _on_unblocked();
+            }
+        }
+
         result_code _do_operations(
                 opflag flag,
                 _Counter count, 
@@ -217,6 +706,8 @@ namespace asyncpp
                 const timeout & to) {
             lock_t lock(mMutex);
             result_code res = result_code::SUCCEED;
+            //whether this call took the block
+            bool blocked = false;
             if (!mEnabled) {
                 return result_code::DISABLED;
             }
@@ -224,40 +715,65 @@ namespace asyncpp
                 if (count == 0) {
                     return result_code::INVALID_ARGUMENTS;
                 }
-                if (count > 1 && !_has_block_flag(flag) && !_blocked_by_this()) {
-                    return result_code::INVALID_ARGUMENTS;
-                }
             }
             if (_has_release_flag(flag)) {
                 if (count == 0) {
                     return result_code::INVALID_ARGUMENTS;
                 }
             }
-            if (_has_block_flag(flag) || _has_acquire_or_reserve_flag(flag)) {
-                res = _wait_block(lock, to);
-                if (res != result_code::SUCCEED) {
-                    return res;
+            if constexpr (_InterProcess) {
+                if (_has_block_flag(flag) || _has_acquire_or_reserve_flag(flag)) {
+                    res = _wait_block(lock, to);
+                    if (res != result_code::SUCCEED) {
+                        return res;
+                    }
                 }
-            }
-            if (_has_block_flag(flag)) {
-                if (!_blocked_by_this()) {
-                    mBlockerID = std::this_thread::get_id();
-                    mCond.notify_all();
+                if (_has_block_flag(flag)) {
+                    if (!_blocked_by_this()) {
+                        mBlockerID = std::this_thread::get_id();
+                        blocked = true;
+                        mCond.notify_all();
+                    }
                 }
-            }
-            if (_has_acquire_or_reserve_flag(flag)) {
-
-                while ((res = _wait_value(lock, count, to)) == result_code::BLOCKED) {
-                    res = _wait_block(lock, to);
+                if (_has_acquire_or_reserve_flag(flag)) {
+                    bool account = _has_acquire_flag(flag) && !_has_block_flag(flag);
+                    while ((res = _wait_value(lock, count, account, to)) == result_code::BLOCKED) {
+                        res = _wait_block(lock, to);
+                        if (res != result_code::SUCCEED) {
+                            return res;
+                        }
+                    }
                     if (res != result_code::SUCCEED) {
+                        _undo_block(blocked);
                         return res;
                     }
+                    if (_has_acquire_flag(flag)) {
+                        mValue -= count;
+                    }
                 }
-                if (res != result_code::SUCCEED) {
-                    return res;
+            } else {
+                if (_has_block_flag(flag) && !_blocked_by_this()) {
+                    if (_blocked()) {
+                        if ((res = _wait_turn(lock, opflag::PREV_BLOCK, 0, to)) != result_code::SUCCEED) {
+                            return res;
+                        }
+                    } else {
+                        mBlockerID = std::this_thread::get_id();
+                    }
+                    blocked = true;
                 }
-                if (_has_acquire_flag(flag)) {
-                    mValue -= count;
+                if (_has_acquire_or_reserve_flag(flag)) {
+                    opflag kind = (opflag)(flag & (opflag::ACQUIRE | opflag::RESERVE));
+                    bool taken = !_blocked_by_others() && _can_take(count);
+                    if (taken) {
+                        _take(flag, count);
+                    } else {
+                        taken = _barge(flag, count);
+                    }
+                    if (!taken && (res = _wait_turn(lock, kind, count, to)) != result_code::SUCCEED) {
+                        _undo_block(blocked);
+                        return res;
+                    }
                 }
             }
             if (proc != nullptr) {
@@ -265,12 +781,12 @@ namespace asyncpp
             }
             if (_has_release_flag(flag)) {
                 mValue += count;
-                mCond.notify_all();
+                _on_released();
             }
             if (_has_unblock_flag(flag)) {
                 if (_blocked()) {
                     mBlockerID = std::thread::id();
-                    mCondBlock.notify_all();
+                    _on_unblocked();
                 }
             }
             return result_code::SUCCEED;
@@ -280,7 +796,6 @@ namespace asyncpp
                 _Counter count, 
                 const proc_t & proc) {
             lock_t lock(mMutex);
-            result_code res = result_code::SUCCEED;
             if (!mEnabled) {
                 return result_code::DISABLED;
             }
@@ -299,31 +814,40 @@ namespace asyncpp
                     return result_code::BLOCKED;
                 }
             }
+            bool blocked = false;
             if (_has_block_flag(flag)) {
                 if (!_blocked_by_this()) {
                     mBlockerID = std::this_thread::get_id();
-                    mCond.notify_all();
+                    blocked = true;
+                    if constexpr (_InterProcess) {
+                        mCond.notify_all();
+                    }
                 }
             }
             if (_has_acquire_or_reserve_flag(flag)) {
-                if (mValue < count) {
+                if (_InterProcess ? !_fits(count) : !_can_take(count)) {
+                    _undo_block(blocked);
                     return result_code::UNAVAILABLE_OR_TIMEOUT;
                 }
-            }
-            if (_has_acquire_flag(flag)) {
-                mValue -= count;
+                if constexpr (_InterProcess) {
+                    if (_has_acquire_flag(flag)) {
+                        mValue -= count;
+                    }
+                } else {
+                    _take(flag, count);
+                }
             }
             if (proc != nullptr) {
                 proc();
             }
             if (_has_release_flag(flag)) {
                 mValue += count;
-                mCond.notify_all();
+                _on_released();
             }
             if (_has_unblock_flag(flag)) {
                 if (_blocked()) {
                     mBlockerID = std::thread::id();
-                    mCondBlock.notify_all();
+                    _on_unblocked();
                 }
             }
             return result_code::SUCCEED;
@@ -334,6 +858,24 @@ namespace asyncpp
         mutable cond_t mCondBlock;
         bool mEnabled = false;
         std::thread::id mBlockerID;
+        std::thread::id mClaimerID;
+        _Counter mClaim = 0;
         _Counter mValue = 0;
+        wait_list mWatchers;
+        order mOrder = order::FIFO;
+        fairness mFairness = fairness::STRICT;
+        uint32_t mMaxBypass = 16;
+        clock::duration mWaitTime = clock::duration::zero();
+        uint32_t mParked = 0;
+        clock::duration mParkedSince = clock::duration::zero();
+        waiter * mHead = nullptr;
+        waiter * mTail = nullptr;
+        waiter * mGranted = nullptr;
+        uint64_t mWakeups = 0;
     };
+
+    //a 64 bit semaphore counting bytes, e.g. to bound the memory held by
+    //buffers in flight: acquire(size) before allocating, release(size) after
+    template<bool _InterProcess = false, template<bool> typename _Policy = sync_policy>
+    using byte_budget = adv_semaphore<_InterProcess, uint64_t, _Policy>;
 }
\ No newline at end of file
@@ -0,0 +1,411 @@
+#pragma once
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "asyncpp/common.hpp"
+#include "asyncpp/timeout.hpp"
+#include "asyncpp/adv_semaphore.hpp"
+#include "asyncpp/adv_queue.hpp"
+
+namespace asyncpp
+{
+    enum io_op {
+        IO_READ = 0,
+        IO_WRITE,
+    };
+
+    struct io_request
+    {
+        int fd = -1;
+        io_op op = io_op::IO_READ;
+        void * buf = nullptr;
+        uint32_t len = 0;
+        uint64_t offset = 0;
+        uint64_t user_data = 0;
+        //index of a registered buffer buf points into, -1 for none
+        int buf_index = -1;
+    };
+
+    struct io_completion
+    {
+        uint64_t user_data = 0;
+        io_op op = io_op::IO_READ;
+        void * buf = nullptr;
+        //bytes transferred, or -errno
+        int64_t result = 0;
+    };
+
+    struct file_io_options
+    {
+        //requests in flight at most, submit() waits for room beyond it
+        uint32_t depth = 128;
+        //blocking workers when io_uring is not available or not wanted
+        uint32_t fallback_threads = 4;
+        bool use_uring = true;
+    };
+
+    //asynchronous pread / pwrite on local files.
+    //requests are submitted in batches to an io_uring and a single thread
+    //reaps the completions and hands them to a callback, or pushes them
+    //into a queue. without io_uring (old kernel, seccomp) a few threads do
+    //blocking I/O instead, same interface.
+    //callbacks run on the reaping thread and should be short.
+    class async_file_io
+    {
+    public:
+        using callback_t = std::function<void(const io_completion &)>;
+    public:
+        async_file_io() = default;
+        async_file_io(const async_file_io &) = delete;
+        async_file_io & operator = (const async_file_io &) = delete;
+        ~async_file_io() {
+            stop();
+        }
+    public:
+        result_code start(const callback_t & on_complete, const file_io_options & options = file_io_options()) {
+            if (on_complete == nullptr || options.depth == 0) {
+                return result_code::INVALID_ARGUMENTS;
+            }
+            if (mStarted) {
+                return result_code::INCORRECT_STATE;
+            }
+            mOnComplete = on_complete;
+            mSlots.set_value(options.depth);
+            mSlots.enable();
+            mUring = options.use_uring && _setup(options.depth) == result_code::SUCCEED;
+            if (mUring) {
+                mThreads.emplace_back([this]() {
+                    _reap();
+                });
+            } else {
+                if (options.fallback_threads == 0) {
+                    mSlots.disable();
+                    return result_code::UNAVAILABLE_OR_TIMEOUT;
+                }
+                mRequests.enable(options.depth);
+                for (uint32_t i = 0; i < options.fallback_threads; ++i) {
+                    mThreads.emplace_back([this]() {
+                        _work();
+                    });
+                }
+            }
+            mStarted = true;
+            return result_code::SUCCEED;
+        }
+        //completions go into queue, anything with push(const io_completion &)
+        template<typename _Queue>
+        result_code start(_Queue & queue, const file_io_options & options = file_io_options()) {
+            return start([&queue](const io_completion & c) {
+                queue.push(c);
+            }, options);
+        }
+
+        //waits for the requests in flight, then stops the threads.
+        //nothing may be submitted meanwhile
+        void stop() {
+            if (!mStarted) {
+                return;
+            }
+            if (mUring) {
+                //a nop the reaper takes as its cue to leave
+                std::lock_guard<std::mutex> lock(mSubmitMutex);
+                io_uring_sqe * sqe = _sqe();
+                sqe->opcode = IORING_OP_NOP;
+                sqe->user_data = stop_tag;
+                _flush(1);
+            } else {
+                mRequests.drain();
+                mRequests.disable();
+            }
+            for (auto & t : mThreads) {
+                t.join();
+            }
+            mThreads.clear();
+            mSlots.disable();
+            _teardown();
+            mRegistered = 0;
+            mStarted = false;
+        }
+
+        bool is_uring() const {
+            return mUring;
+        }
+        uint32_t get_in_flight() const {
+            return mInFlight.load(std::memory_order_relaxed);
+        }
+
+        //pins buffers for IORING_OP_READ_FIXED / WRITE_FIXED, which skip
+        //mapping the pages on every request. call before submitting, the
+        //fallback accepts and ignores them
+        result_code register_buffers(const struct iovec * iovs, uint32_t count) {
+            if (!mStarted || iovs == nullptr || count == 0) {
+                return result_code::INVALID_ARGUMENTS;
+            }
+            if (mUring && syscall(__NR_io_uring_register, mRingFd, IORING_REGISTER_BUFFERS, iovs, count) != 0) {
+                return result_code::UNAVAILABLE_OR_TIMEOUT;
+            }
+            mRegistered = count;
+            return result_code::SUCCEED;
+        }
+
+        //queues count requests, waiting for room as needed, and submits them
+        //with as few system calls as the depth allows.
+        //submitted tells how many went out when it fails halfway
+        result_code submit(const io_request * requests, uint32_t count, uint32_t & submitted, const timeout & to = timeout()) {
+            submitted = 0;
+            if (!mStarted) {
+                return result_code::INCORRECT_STATE;
+            }
+            for (uint32_t i = 0; i < count; ++i) {
+                if (!_valid(requests[i])) {
+                    return result_code::INVALID_ARGUMENTS;
+                }
+            }
+            while (submitted < count) {
+                //as much of the batch as there is room for, at least one
+                uint32_t n = count - submitted;
+                uint32_t room = (uint32_t)mSlots.get_value();
+                n = room == 0 ? 1 : (n < room ? n : room);
+                result_code res = mSlots.acquire(n, nullptr, to);
+                if (res != result_code::SUCCEED) {
+                    return res;
+                }
+                mInFlight.fetch_add(n, std::memory_order_relaxed);
+                if (mUring) {
+                    _submit_uring(requests + submitted, n);
+                } else {
+                    for (uint32_t i = 0; i < n; ++i) {
+                        mRequests.push(requests[submitted + i]);
+                    }
+                }
+                submitted += n;
+            }
+            return result_code::SUCCEED;
+        }
+        result_code submit(const io_request & request, const timeout & to = timeout()) {
+            uint32_t submitted = 0;
+            return submit(&request, 1, submitted, to);
+        }
+    private:
+        static constexpr uint64_t stop_tag = ~(uint64_t)0;
+
+        bool _valid(const io_request & r) const {
+            return r.fd >= 0
+                && r.buf != nullptr
+                && r.user_data != stop_tag
+                && r.buf_index < (int)mRegistered;
+        }
+
+        void _complete(const io_request & r, int64_t result) {
+            mOnComplete(io_completion{r.user_data, r.op, r.buf, result});
+            mInFlight.fetch_sub(1, std::memory_order_relaxed);
+            mSlots.release();
+        }
+
+        //fallback
+        void _work() {
+            io_request r;
+            while (mRequests.pop(r) == result_code::SUCCEED) {
+                ssize_t res = r.op == io_op::IO_READ
+                    ? pread(r.fd, r.buf, r.len, (off_t)r.offset)
+                    : pwrite(r.fd, r.buf, r.len, (off_t)r.offset);
+                _complete(r, res < 0 ? -(int64_t)errno : (int64_t)res);
+            }
+        }
+
+        //io_uring, set up by hand to go without liburing
+        result_code _setup(uint32_t depth) {
+            io_uring_params params;
+            std::memset(&params, 0, sizeof(params));
+            int fd = (int)syscall(__NR_io_uring_setup, depth, &params);
+            if (fd < 0) {
+                return result_code::UNAVAILABLE_OR_TIMEOUT;
+            }
+            mRingFd = fd;
+            mSqSize = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+            mCqSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+            bool single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+            if (single && mCqSize > mSqSize) {
+                mSqSize = mCqSize;
+            }
+            mSq = mmap(nullptr, mSqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+            mCq = single ? mSq : mmap(nullptr, mCqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+            mSqes = static_cast<io_uring_sqe *>(mmap(nullptr, params.sq_entries * sizeof(io_uring_sqe),
+                PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES));
+            mSqeCount = params.sq_entries;
+            if (mSq == MAP_FAILED || mCq == MAP_FAILED || mSqes == MAP_FAILED) {
+                _teardown();
+                return result_code::UNAVAILABLE_OR_TIMEOUT;
+            }
+            uint8_t * sq = static_cast<uint8_t *>(mSq);
+            uint8_t * cq = static_cast<uint8_t *>(mCq);
+            mSqTail = reinterpret_cast<std::atomic<uint32_t> *>(sq + params.sq_off.tail);
+            mSqHead = reinterpret_cast<std::atomic<uint32_t> *>(sq + params.sq_off.head);
+            mSqMask = *reinterpret_cast<uint32_t *>(sq + params.sq_off.ring_mask);
+            mSqArray = reinterpret_cast<uint32_t *>(sq + params.sq_off.array);
+            mCqHead = reinterpret_cast<std::atomic<uint32_t> *>(cq + params.cq_off.head);
+            mCqTail = reinterpret_cast<std::atomic<uint32_t> *>(cq + params.cq_off.tail);
+            mCqMask = *reinterpret_cast<uint32_t *>(cq + params.cq_off.ring_mask);
+            mCqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+            //the completion queue is twice the depth, it never overflows
+            return result_code::SUCCEED;
+        }
+
+        void _teardown() {
+            if (mSqes != nullptr && mSqes != MAP_FAILED) {
+                munmap(mSqes, mSqeCount * sizeof(io_uring_sqe));
+            }
+            if (mCq != nullptr && mCq != MAP_FAILED && mCq != mSq) {
+                munmap(mCq, mCqSize);
+            }
+            if (mSq != nullptr && mSq != MAP_FAILED) {
+                munmap(mSq, mSqSize);
+            }
+            if (mRingFd >= 0) {
+                ::close(mRingFd);
+            }
+            mSq = mCq = nullptr;
+            mSqes = nullptr;
+            mRingFd = -1;
+        }
+
+        //the next free entry, under mSubmitMutex. in-flight requests never
+        //outnumber the entries, so one is free once the kernel consumed
+        //what was flushed before
+        io_uring_sqe * _sqe() {
+            uint32_t tail = mSqTail->load(std::memory_order_relaxed);
+            while (tail - mSqHead->load(std::memory_order_acquire) >= mSqeCount) {
+                std::this_thread::yield();
+            }
+            uint32_t index = tail & mSqMask;
+            io_uring_sqe * sqe = &mSqes[index];
+            std::memset(sqe, 0, sizeof(*sqe));
+            mSqArray[index] = index;
+            mSqTail->store(tail + 1, std::memory_order_release);
+            return sqe;
+        }
+
+        void _flush(uint32_t count) {
+            while (count > 0) {
+                long res = syscall(__NR_io_uring_enter, mRingFd, count, 0, 0, nullptr, 0);
+                if (res < 0) {
+                    if (errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+                        continue;
+                    }
+                    return;
+                }
+                if (res == 0) {
+                    return;
+                }
+                count -= (uint32_t)res;
+            }
+        }
+
+        void _submit_uring(const io_request * requests, uint32_t count) {
+            std::lock_guard<std::mutex> lock(mSubmitMutex);
+            for (uint32_t i = 0; i < count; ++i) {
+                const io_request & r = requests[i];
+                io_uring_sqe * sqe = _sqe();
+                bool fixed = r.buf_index >= 0;
+                if (r.op == io_op::IO_READ) {
+                    sqe->opcode = fixed ? IORING_OP_READ_FIXED : IORING_OP_READ;
+                } else {
+                    sqe->opcode = fixed ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+                }
+                sqe->fd = r.fd;
+                sqe->addr = (uint64_t)(uintptr_t)r.buf;
+                sqe->len = r.len;
+                sqe->off = r.offset;
+                sqe->buf_index = fixed ? (uint16_t)r.buf_index : 0;
+                sqe->user_data = (uint64_t)(uintptr_t)_track(r);
+            }
+            _flush(count);
+        }
+
+        //a request's fields are needed again at completion, the kernel
+        //only hands back user_data. kept in a list for stable addresses
+        io_request * _track(const io_request & r) {
+            std::lock_guard<std::mutex> lock(mTrackMutex);
+            if (mFree.empty()) {
+                mTracked.emplace_back(r);
+                return &mTracked.back();
+            }
+            io_request * t = mFree.back();
+            mFree.pop_back();
+            *t = r;
+            return t;
+        }
+        void _untrack(io_request * t) {
+            std::lock_guard<std::mutex> lock(mTrackMutex);
+            mFree.push_back(t);
+        }
+
+        void _reap() {
+            bool stopping = false;
+            while (!stopping || mInFlight.load(std::memory_order_relaxed) > 0) {
+                uint32_t head = mCqHead->load(std::memory_order_relaxed);
+                uint32_t tail = mCqTail->load(std::memory_order_acquire);
+                if (head == tail) {
+                    syscall(__NR_io_uring_enter, mRingFd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+                    continue;
+                }
+                for (; head != tail; ++head) {
+                    io_uring_cqe & cqe = mCqes[head & mCqMask];
+                    if (cqe.user_data == stop_tag) {
+                        stopping = true;
+                        continue;
+                    }
+                    io_request * r = reinterpret_cast<io_request *>((uintptr_t)cqe.user_data);
+                    int64_t res = cqe.res;
+                    io_request done = *r;
+                    _untrack(r);
+                    _complete(done, res);
+                }
+                mCqHead->store(head, std::memory_order_release);
+            }
+        }
+    private:
+        bool mStarted = false;
+        bool mUring = false;
+        callback_t mOnComplete;
+        adv_semaphore<> mSlots;
+        std::atomic<uint32_t> mInFlight = 0;
+        uint32_t mRegistered = 0;
+        std::vector<std::thread> mThreads;
+        //fallback
+        adv_queue<io_request> mRequests;
+        //io_uring
+        int mRingFd = -1;
+        void * mSq = nullptr;
+        void * mCq = nullptr;
+        std::size_t mSqSize = 0;
+        std::size_t mCqSize = 0;
+        io_uring_sqe * mSqes = nullptr;
+        uint32_t mSqeCount = 0;
+        std::atomic<uint32_t> * mSqHead = nullptr;
+        std::atomic<uint32_t> * mSqTail = nullptr;
+        uint32_t mSqMask = 0;
+        uint32_t * mSqArray = nullptr;
+        std::atomic<uint32_t> * mCqHead = nullptr;
+        std::atomic<uint32_t> * mCqTail = nullptr;
+        uint32_t mCqMask = 0;
+        io_uring_cqe * mCqes = nullptr;
+        std::mutex mSubmitMutex;
+        std::mutex mTrackMutex;
+        std::list<io_request> mTracked;
+        std::vector<io_request *> mFree;
+    };
+}
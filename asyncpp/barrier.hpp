@@ -5,11 +5,16 @@
 #include <chrono>
 #include <functional>
 
-#include "common.hpp"
+#include "asyncpp/common.hpp"
+#include "asyncpp/timeout.hpp"
+#include "asyncpp/pthread_wrapper.hpp"
 
 namespace asyncpp
 {
-    template<typename _Counter = uint32_t, bool _InterProcess = false>
+    template<
+        typename _Counter = uint32_t,
+        bool _InterProcess = false,
+        template<bool> typename _Policy = sync_policy>
     class barrier
     {
     public:
@@ -17,9 +22,9 @@ namespace asyncpp
         barrier(const barrier &) = delete;
         barrier & operator = (const barrier &) = delete;
     private:
-        using mutex_t = asyncpp::mutex<_InterProcess>;
-        using cond_t = asyncpp::condition_variable<_InterProcess>;
-        using lock_t = std::unique_lock<std::mutex>;
+        using mutex_t = typename _Policy<_InterProcess>::mutex_t;
+        using cond_t = typename _Policy<_InterProcess>::cond_t;
+        using lock_t = typename _Policy<_InterProcess>::lock_t;
     public:
         result_code enable(_Counter total) {
             if (total == 0) {
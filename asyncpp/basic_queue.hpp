@@ -1,5 +1,6 @@
 #pragma once
 #include <list>
+#include <vector>
 #include <mutex>
 #include <functional>
 #include <atomic>
@@ -7,11 +8,16 @@
 #include <asyncpp/common.hpp>
 #include <asyncpp/timeout.hpp>
 #include <asyncpp/basic_semaphore.hpp>
+#include <asyncpp/sojourn.hpp>
 
 namespace asyncpp
 {
 
-    template<typename _Item, bool _InterProcess = false, typename _Queue=std::list<_Item>>
+    template<
+        typename _Item,
+        bool _InterProcess = false,
+        typename _Queue = std::list<_Item>,
+        template<bool> typename _Policy = sync_policy>
     class basic_queue
     {
     public:
@@ -19,8 +25,10 @@ namespace asyncpp
         basic_queue(const basic_queue &) = delete;
         basic_queue & operator = (const basic_queue &) = delete;
     public:
-        using mutex_t = asyncpp::mutex<_InterProcess>;
-        using lock_t = std::unique_lock<std::mutex>;
+        using item_type = _Item;
+        using mutex_t = typename _Policy<_InterProcess>::mutex_t;
+        using lock_t = typename _Policy<_InterProcess>::lock_t;
+        using traits_t = sojourn_traits<_Item, _Queue>;
     public:
         //manipulating functions:
         result_code enable(uint32_t capacity) {
@@ -59,11 +67,29 @@ namespace asyncpp
             return mQueue.size();
         }
 
+        //time items spent queued, in nanoseconds.
+        //only for queues whose container holds stamped<_Item>
+        latency_histogram & get_sojourn() {
+            static_assert(traits_t::tracked, "the container does not hold stamped items");
+            return mSojourn;
+        }
+
+        //select support: readiness to pop
+        result_code attach(wait_node & node) {
+            return mSemP.attach(node);
+        }
+        void detach(wait_node & node) {
+            mSemP.detach(node);
+        }
+        bool ready() const {
+            return mSemP.ready();
+        }
+
         //data functions
         result_code push(const _Item & item, const timeout & to = timeout()) {
             result_code res = result_code::SUCCEED;
             auto on_acquired = [&]() {
-                mQueue.emplace_back(item);
+                traits_t::put(mQueue, item);
             };
             if ((res = mSemC.acquire(to, on_acquired)) != result_code::SUCCEED) {
                 return res;
@@ -74,7 +100,7 @@ namespace asyncpp
         result_code push(_Item && item, const timeout & to = timeout()) {
             result_code res = result_code::SUCCEED;
             auto on_acquired = [&]() {
-                mQueue.emplace_back(std::move(item));
+                traits_t::put(mQueue, std::move(item));
             };
             if ((res = mSemC.acquire(to, on_acquired)) != result_code::SUCCEED) {
                 return res;
@@ -86,7 +112,7 @@ namespace asyncpp
         result_code try_push(const _Item & item) {
             result_code res = result_code::SUCCEED;
             auto on_acquired = [&]() {
-                mQueue.emplace_back(item);
+                traits_t::put(mQueue, item);
             };
             if ((res = mSemC.try_acquire(on_acquired)) != result_code::SUCCEED) {
                 return res;
@@ -97,7 +123,7 @@ namespace asyncpp
         result_code try_push(_Item && item) {
             result_code res = result_code::SUCCEED;
             auto on_acquired = [&]() {
-                mQueue.emplace_back(std::move(item));
+                traits_t::put(mQueue, std::move(item));
             };
             if ((res = mSemC.try_acquire(on_acquired)) != result_code::SUCCEED) {
                 return res;
@@ -112,8 +138,7 @@ namespace asyncpp
                 return res;
             }
             mSemC.release([&]() {
-                item = std::move(mQueue.front());
-                mQueue.pop_front();
+                traits_t::take(mQueue, item, mSojourn);
             });
             return res;
         }
@@ -123,16 +148,52 @@ namespace asyncpp
                 return res;
             }
             mSemC.release([&]() {
-                item = std::move(mQueue.front());
-                mQueue.pop_front();
+                traits_t::take(mQueue, item, mSojourn);
             });
             return res;
         }
+
+        //waits until min_items are queued or linger has passed, then takes
+        //up to max_items under one lock and appends them to out
+        result_code pop_batch(
+                std::vector<_Item> & out,
+                uint32_t min_items,
+                uint32_t max_items,
+                const timeout & linger = timeout()) {
+            result_code res = result_code::SUCCEED;
+            uint32_t count = 0;
+            if ((res = mSemP.acquire_batch(min_items, max_items, count, linger)) != result_code::SUCCEED) {
+                return res;
+            }
+            _finish_batch(out, count);
+            return res;
+        }
+        //takes up to max_items of what is queued, never waits
+        result_code try_pop_batch(std::vector<_Item> & out, uint32_t max_items) {
+            result_code res = result_code::SUCCEED;
+            uint32_t count = 0;
+            if ((res = mSemP.try_acquire_batch(max_items, count)) != result_code::SUCCEED) {
+                return res;
+            }
+            _finish_batch(out, count);
+            return res;
+        }
+    private:
+        void _finish_batch(std::vector<_Item> & out, uint32_t count) {
+            std::size_t first = out.size();
+            out.resize(first + count);
+            mSemC.release(count, [&]() {
+                for (uint32_t i = 0; i < count; ++i) {
+                    traits_t::take(mQueue, out[first + i], mSojourn);
+                }
+            });
+        }
     private:
         mutex_t mMutex;
         std::atomic<uint32_t> mCapacity = 0;
-        basic_semaphore<_InterProcess> mSemP;
-        basic_semaphore<_InterProcess> mSemC;
+        basic_semaphore<_InterProcess, uint32_t, _Policy> mSemP;
+        basic_semaphore<_InterProcess, uint32_t, _Policy> mSemC;
         _Queue mQueue;
+        typename traits_t::histogram_t mSojourn;
     };
 }
\ No newline at end of file
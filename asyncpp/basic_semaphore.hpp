@@ -7,23 +7,25 @@
 #include "asyncpp/common.hpp"
 #include "asyncpp/timeout.hpp"
 #include "asyncpp/pthread_wrapper.hpp"
+#include "asyncpp/wait_list.hpp"
 
 namespace asyncpp
 {
     template<
         bool _InterProcess = false,
         typename _Counter = uint32_t, 
-        typename = typename std::enable_if<std::is_unsigned<_Counter>::value>::type>
+        template<bool> typename _Policy = sync_policy>
     class basic_semaphore
     {
+        static_assert(std::is_unsigned<_Counter>::value, "counter must be unsigned");
     public:
         basic_semaphore() = default;
         basic_semaphore(const basic_semaphore &) = delete;
         basic_semaphore & operator = (const basic_semaphore &) = delete;
     public:
-        using mutex_t = asyncpp::mutex<_InterProcess>;
-        using cond_t = asyncpp::condition_variable<_InterProcess>;
-        using lock_t = std::unique_lock<std::mutex>;
+        using mutex_t = typename _Policy<_InterProcess>::mutex_t;
+        using cond_t = typename _Policy<_InterProcess>::cond_t;
+        using lock_t = typename _Policy<_InterProcess>::lock_t;
         using proc_t = std::function<void()>;
         result_code set_value(_Counter value) {
             lock_t lock(mMutex);
@@ -50,9 +52,28 @@ namespace asyncpp
             }
             mEnabled = false;
             mCond.notify_all();
+            mWatchers.notify_all();
             return result_code::SUCCEED;
         }
 
+        //select support, in-process only.
+        //watchers are called back whenever an acquire may have become possible
+        result_code attach(wait_node & node) {
+            static_assert(!_InterProcess, "watchers are process local");
+            lock_t lock(mMutex);
+            mWatchers.attach(&node);
+            return result_code::SUCCEED;
+        }
+        void detach(wait_node & node) {
+            lock_t lock(mMutex);
+            mWatchers.detach(&node);
+        }
+        //whether acquire() would return without blocking, disabled counts as ready
+        bool ready() const {
+            lock_t lock(mMutex);
+            return !mEnabled || mValue > 0;
+        }
+
         result_code acquire(
                 const timeout & to = timeout(), 
                 const proc_t & on_acquired = nullptr) {
@@ -94,6 +115,68 @@ namespace asyncpp
             return result_code::SUCCEED;
         }
 
+        //takes between min and max permits at once, taken tells how many.
+        //waits for min until to, then takes what there is up to max,
+        //UNAVAILABLE_OR_TIMEOUT only when to passes with none
+        result_code acquire_batch(
+                _Counter min,
+                _Counter max,
+                _Counter & taken,
+                const timeout & to = timeout(),
+                const proc_t & on_acquired = nullptr) {
+            taken = 0;
+            if (min == 0 || max < min) {
+                return result_code::INVALID_ARGUMENTS;
+            }
+            lock_t lock(mMutex);
+            if (!mEnabled) {
+                return result_code::DISABLED;
+            }
+            while (mValue < min) {
+                if (to.has_value()) {
+                    if (mCond.wait_until(lock, to.value()) == std::cv_status::timeout) {
+                        break;
+                    }
+                } else {
+                    mCond.wait(lock);
+                }
+                if (!mEnabled) {
+                    return result_code::DISABLED;
+                }
+            }
+            if (mValue == 0) {
+                return result_code::UNAVAILABLE_OR_TIMEOUT;
+            }
+            taken = mValue < max ? mValue : max;
+            mValue -= taken;
+            if (on_acquired != nullptr) {
+                on_acquired();
+            }
+            return result_code::SUCCEED;
+        }
+        result_code try_acquire_batch(
+                _Counter max,
+                _Counter & taken,
+                const proc_t & on_acquired = nullptr) {
+            taken = 0;
+            if (max == 0) {
+                return result_code::INVALID_ARGUMENTS;
+            }
+            lock_t lock(mMutex);
+            if (!mEnabled) {
+                return result_code::DISABLED;
+            }
+            if (mValue == 0) {
+                return result_code::UNAVAILABLE_OR_TIMEOUT;
+            }
+            taken = mValue < max ? mValue : max;
+            mValue -= taken;
+            if (on_acquired != nullptr) {
+                on_acquired();
+            }
+            return result_code::SUCCEED;
+        }
+
         result_code release(const proc_t & on_releasing = nullptr) {
             lock_t lock(mMutex);
             if (!mEnabled) {
@@ -105,6 +188,23 @@ namespace asyncpp
             ++mValue;
             //notify_all is always faster than notify_one
             mCond.notify_all();
+            mWatchers.notify_all();
+            return result_code::SUCCEED;
+        }
+        result_code release(_Counter count, const proc_t & on_releasing = nullptr) {
+            if (count == 0) {
+                return result_code::INVALID_ARGUMENTS;
+            }
+            lock_t lock(mMutex);
+            if (!mEnabled) {
+                return result_code::DISABLED;
+            }
+            if (on_releasing != nullptr) {
+                on_releasing();
+            }
+            mValue += count;
+            mCond.notify_all();
+            mWatchers.notify_all();
             return result_code::SUCCEED;
         }
     private:
@@ -112,5 +212,6 @@ namespace asyncpp
         mutable cond_t mCond;
         bool mEnabled = false;
         _Counter mValue = 0;
+        wait_list mWatchers;
     };
 }
\ No newline at end of file
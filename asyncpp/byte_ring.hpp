@@ -0,0 +1,261 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "asyncpp/common.hpp"
+#include "asyncpp/timeout.hpp"
+#include "asyncpp/pthread_wrapper.hpp"
+#include "asyncpp/wait_strategy.hpp"
+
+namespace asyncpp
+{
+    //ring of variable length records, _Cap bytes stored inline so the whole
+    //ring can be placed in shared memory.
+    //a record is an 8 byte header followed by the payload, padded to 8 bytes.
+    //a record never wraps: when it does not fit before the end of the buffer
+    //a padding record fills the rest and the record starts over at offset 0.
+    //writers reserve() space, fill it in place and commit() it; readers
+    //read() a record in place and release() it when done. writers are
+    //serialized among themselves between reserve and commit, so are readers
+    //between read and release; a timed reserve() or read() waits for its
+    //turn only until the deadline.
+    template<
+        std::size_t _Cap,
+        bool _InterProcess = false,
+        typename _Wait = phased_wait<_InterProcess>,
+        template<bool> typename _Policy = sync_policy>
+    class byte_ring
+    {
+        static_assert(_Cap >= 64 && (_Cap & (_Cap - 1)) == 0, "capacity must be a power of two");
+        static_assert(std::atomic<uint64_t>::is_always_lock_free, "lock free atomics required");
+    public:
+        byte_ring() = default;
+        byte_ring(const byte_ring &) = delete;
+        byte_ring & operator = (const byte_ring &) = delete;
+    public:
+        using mutex_t = typename _Policy<_InterProcess>::mutex_t;
+
+        static constexpr std::size_t header_size = 8;
+        //the largest payload, keeps a record plus its padding within _Cap
+        static constexpr std::size_t max_record = _Cap / 2 - header_size;
+    public:
+        //manipulating functions, not to be called while the ring is in use
+        result_code enable() {
+            mHead.store(0, std::memory_order_relaxed);
+            mTail.store(0, std::memory_order_relaxed);
+            mEnabled.store(true, std::memory_order_release);
+            return result_code::SUCCEED;
+        }
+        //wakes everyone up, records already committed can still be read
+        void disable() {
+            mEnabled.store(false, std::memory_order_release);
+            mWritable.notify();
+            mReadable.notify();
+        }
+
+        std::size_t get_used() const {
+            return (std::size_t)(mHead.load(std::memory_order_acquire) - mTail.load(std::memory_order_acquire));
+        }
+
+        //writer side
+        //on SUCCEED buf points to size writable bytes inside the ring and
+        //the caller holds the writer lock until commit() or cancel()
+        result_code reserve(std::size_t size, void *& buf, const timeout & to = timeout()) {
+            if (size > max_record) {
+                return result_code::INVALID_ARGUMENTS;
+            }
+            result_code res = _lock(mWriteMutex, mWriterLeft, to);
+            if (res != result_code::SUCCEED) {
+                return res;
+            }
+            uint64_t head = mHead.load(std::memory_order_relaxed);
+            uint64_t need = _span(head, size);
+            res = mWritable.wait([&] {
+                return !_enabled() || _free(head) >= need;
+            }, to);
+            if (!_enabled()) {
+                res = result_code::DISABLED;
+            }
+            if (res != result_code::SUCCEED) {
+                _unlock(mWriteMutex, mWriterLeft);
+                return res;
+            }
+            mReserved = size;
+            buf = mData + _offset(head + need - _record(size)) + header_size;
+            return result_code::SUCCEED;
+        }
+        result_code try_reserve(std::size_t size, void *& buf) {
+            if (size > max_record) {
+                return result_code::INVALID_ARGUMENTS;
+            }
+            if (!mWriteMutex.try_lock()) {
+                return result_code::UNAVAILABLE_OR_TIMEOUT;
+            }
+            uint64_t head = mHead.load(std::memory_order_relaxed);
+            uint64_t need = _span(head, size);
+            if (!_enabled() || _free(head) < need) {
+                _unlock(mWriteMutex, mWriterLeft);
+                return _enabled() ? result_code::UNAVAILABLE_OR_TIMEOUT : result_code::DISABLED;
+            }
+            mReserved = size;
+            buf = mData + _offset(head + need - _record(size)) + header_size;
+            return result_code::SUCCEED;
+        }
+
+        //publishes the reserved record, size may be less than reserved
+        result_code commit(std::size_t size) {
+            if (size > mReserved) {
+                return result_code::INVALID_ARGUMENTS;
+            }
+            uint64_t head = mHead.load(std::memory_order_relaxed);
+            uint64_t pad = _span(head, mReserved) - _record(mReserved);
+            if (pad > 0) {
+                _write_header(head, (uint32_t)(pad - header_size), PADDING);
+            }
+            _write_header(head + pad, (uint32_t)size, 0);
+            mHead.store(head + pad + _record(size), std::memory_order_release);
+            _unlock(mWriteMutex, mWriterLeft);
+            mReadable.notify();
+            return result_code::SUCCEED;
+        }
+        void cancel() {
+            _unlock(mWriteMutex, mWriterLeft);
+        }
+
+        //copies data into a new record
+        result_code push(const void * data, std::size_t size, const timeout & to = timeout()) {
+            void * buf = nullptr;
+            result_code res = reserve(size, buf, to);
+            if (res != result_code::SUCCEED) {
+                return res;
+            }
+            std::memcpy(buf, data, size);
+            return commit(size);
+        }
+
+        //reader side
+        //on SUCCEED data points to the oldest record, valid until release()
+        result_code read(const void *& data, std::size_t & size, const timeout & to = timeout()) {
+            result_code res = _lock(mReadMutex, mReaderLeft, to);
+            if (res != result_code::SUCCEED) {
+                return res;
+            }
+            res = mReadable.wait([&] {
+                return _readable() || !_enabled();
+            }, to);
+            if (!_readable()) {
+                _unlock(mReadMutex, mReaderLeft);
+                return res != result_code::SUCCEED ? res : result_code::DISABLED;
+            }
+            _locate(data, size);
+            return result_code::SUCCEED;
+        }
+        result_code try_read(const void *& data, std::size_t & size) {
+            if (!mReadMutex.try_lock()) {
+                return result_code::UNAVAILABLE_OR_TIMEOUT;
+            }
+            if (!_readable()) {
+                _unlock(mReadMutex, mReaderLeft);
+                return _enabled() ? result_code::UNAVAILABLE_OR_TIMEOUT : result_code::DISABLED;
+            }
+            _locate(data, size);
+            return result_code::SUCCEED;
+        }
+
+        //frees the record returned by the last read()
+        void release() {
+            uint64_t tail = mTail.load(std::memory_order_relaxed);
+            uint32_t len = _header(tail).length;
+            mTail.store(tail + _record(len), std::memory_order_release);
+            _unlock(mReadMutex, mReaderLeft);
+            mWritable.notify();
+        }
+    private:
+        enum : uint32_t {
+            PADDING = 1,
+        };
+
+        struct header
+        {
+            uint32_t length;
+            uint32_t flags;
+        };
+
+        //a side's lock is held from reserve or read until the record is
+        //done with, timed callers wait for it on the side's _Wait.
+        //the predicate takes the lock when it turns true
+        static result_code _lock(mutex_t & mutex, _Wait & left, const timeout & to) {
+            if (!to.has_value()) {
+                mutex.lock();
+                return result_code::SUCCEED;
+            }
+            return left.wait([&] {
+                return mutex.try_lock();
+            }, to);
+        }
+        static void _unlock(mutex_t & mutex, _Wait & left) {
+            mutex.unlock();
+            left.notify();
+        }
+
+        static inline std::size_t _offset(uint64_t pos) {
+            return (std::size_t)(pos & (_Cap - 1));
+        }
+        static inline uint64_t _record(std::size_t size) {
+            return header_size + ((size + 7) & ~(uint64_t)7);
+        }
+        //bytes a record of size takes when written at pos, with padding
+        static inline uint64_t _span(uint64_t pos, std::size_t size) {
+            std::size_t offset = _offset(pos);
+            uint64_t record = _record(size);
+            return offset + record <= _Cap ? record : (_Cap - offset) + record;
+        }
+
+        inline bool _enabled() const {
+            return mEnabled.load(std::memory_order_acquire);
+        }
+        inline uint64_t _free(uint64_t head) const {
+            return _Cap - (head - mTail.load(std::memory_order_acquire));
+        }
+        inline bool _readable() const {
+            return mHead.load(std::memory_order_acquire) != mTail.load(std::memory_order_relaxed);
+        }
+
+        header & _header(uint64_t pos) {
+            return *reinterpret_cast<header *>(mData + _offset(pos));
+        }
+        void _write_header(uint64_t pos, uint32_t length, uint32_t flags) {
+            header & h = _header(pos);
+            h.length = length;
+            h.flags = flags;
+        }
+
+        //skips padding, under the reader lock with a record available
+        void _locate(const void *& data, std::size_t & size) {
+            uint64_t tail = mTail.load(std::memory_order_relaxed);
+            if ((_header(tail).flags & PADDING) != 0) {
+                //padding always runs to the end of the buffer and the record
+                //it was written for follows at offset 0
+                tail += _Cap - _offset(tail);
+                mTail.store(tail, std::memory_order_release);
+            }
+            data = mData + _offset(tail) + header_size;
+            size = _header(tail).length;
+        }
+    private:
+        alignas(64) std::atomic<uint64_t> mHead = 0;
+        std::size_t mReserved = 0;
+        mutex_t mWriteMutex;
+        _Wait mWriterLeft;
+        _Wait mWritable;
+        alignas(64) std::atomic<uint64_t> mTail = 0;
+        mutex_t mReadMutex;
+        _Wait mReaderLeft;
+        _Wait mReadable;
+        alignas(64) std::atomic<bool> mEnabled = false;
+        alignas(64) uint8_t mData[_Cap];
+    };
+}
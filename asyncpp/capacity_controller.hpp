@@ -0,0 +1,226 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <thread>
+
+#include "asyncpp/common.hpp"
+#include "asyncpp/timeout.hpp"
+#include "asyncpp/pthread_wrapper.hpp"
+
+namespace asyncpp
+{
+    enum capacity_policy {
+        //additive increase while producers block,
+        //multiplicative decrease while consumers sit idle
+        CAPACITY_AIMD = 0,
+        //capacity = throughput * target wait (Little's law)
+        CAPACITY_TARGET_WAIT,
+    };
+
+    //what one sample saw and what was done about it
+    struct capacity_decision
+    {
+        uint64_t old_capacity = 0;
+        uint64_t new_capacity = 0;
+        uint64_t size = 0;
+        //time parked in push / pop per second of wall time, summed over
+        //threads, so 2.0 means two threads blocked for the whole period
+        double producer_blocked = 0;
+        double consumer_idle = 0;
+        //pops per second
+        double throughput = 0;
+        //result of change_capacity, SUCCEED when the capacity was kept
+        result_code applied = result_code::SUCCEED;
+    };
+
+    //adjusts the capacity of an adv_queue within [min, max] from its load
+    //statistics. sample() runs one step and may be driven by the caller's
+    //own timer, or start() runs it periodically on a thread of its own.
+    //the queue must outlive the controller.
+    template<typename _Queue>
+    class capacity_controller
+    {
+    public:
+        using mutex_t = typename sync_policy<false>::mutex_t;
+        using cond_t = typename sync_policy<false>::cond_t;
+        using lock_t = typename sync_policy<false>::lock_t;
+        using callback_t = std::function<void(const capacity_decision &)>;
+    public:
+        explicit capacity_controller(_Queue & queue) : mQueue(queue) {}
+        capacity_controller(const capacity_controller &) = delete;
+        capacity_controller & operator = (const capacity_controller &) = delete;
+        ~capacity_controller() {
+            stop();
+        }
+    public:
+        //configuring functions, call them while the controller is stopped
+        result_code configure(uint64_t min, uint64_t max, capacity_policy policy) {
+            if (min == 0 || min > max) {
+                return result_code::INVALID_ARGUMENTS;
+            }
+            mMin = min;
+            mMax = max;
+            mPolicy = policy;
+            return result_code::SUCCEED;
+        }
+
+        //block_threshold and idle_threshold are in the units of
+        //capacity_decision::producer_blocked and consumer_idle
+        result_code set_aimd(
+                uint64_t increase,
+                double decrease,
+                double block_threshold = 0.05,
+                double idle_threshold = 0.5) {
+            if (increase == 0 || decrease <= 0 || decrease >= 1) {
+                return result_code::INVALID_ARGUMENTS;
+            }
+            mIncrease = increase;
+            mDecrease = decrease;
+            mBlockThreshold = block_threshold;
+            mIdleThreshold = idle_threshold;
+            return result_code::SUCCEED;
+        }
+
+        //smoothing is the weight of the newest throughput sample
+        result_code set_target_wait(clock::duration target, double smoothing = 0.3) {
+            if (target <= clock::duration::zero() || smoothing <= 0 || smoothing > 1) {
+                return result_code::INVALID_ARGUMENTS;
+            }
+            mTarget = target;
+            mSmoothing = smoothing;
+            return result_code::SUCCEED;
+        }
+
+        //called after every sample, on the sampling thread
+        void on_decision(const callback_t & callback) {
+            mCallback = callback;
+        }
+
+        //one control step over the statistics gathered since the last one
+        capacity_decision sample() {
+            time_point now = clock::now();
+            clock::duration push_wait = mQueue.get_push_wait_time();
+            clock::duration pop_wait = mQueue.get_pop_wait_time();
+            uint64_t pops = mQueue.get_pop_count();
+
+            capacity_decision d;
+            d.old_capacity = mQueue.get_capacity();
+            d.new_capacity = d.old_capacity;
+            d.size = mQueue.get_size();
+            if (mLastSample != time_point() && now > mLastSample) {
+                double elapsed = std::chrono::duration<double>(now - mLastSample).count();
+                d.producer_blocked = std::chrono::duration<double>(push_wait - mLastPushWait).count() / elapsed;
+                d.consumer_idle = std::chrono::duration<double>(pop_wait - mLastPopWait).count() / elapsed;
+                d.throughput = (double)(pops - mLastPops) / elapsed;
+                d.new_capacity = _decide(d);
+            }
+            mLastSample = now;
+            mLastPushWait = push_wait;
+            mLastPopWait = pop_wait;
+            mLastPops = pops;
+
+            if (d.new_capacity != d.old_capacity) {
+                //a shrink waits for consumers to free the slots, give up
+                //rather than stall producers for long
+                d.applied = mQueue.change_capacity(d.new_capacity, timeout(mShrinkTimeout));
+                if (d.applied != result_code::SUCCEED) {
+                    d.new_capacity = mQueue.get_capacity();
+                }
+            }
+            if (mCallback != nullptr) {
+                mCallback(d);
+            }
+            return d;
+        }
+
+        result_code start(clock::duration period) {
+            if (period <= clock::duration::zero()) {
+                return result_code::INVALID_ARGUMENTS;
+            }
+            lock_t lock(mMutex);
+            if (mThread.joinable()) {
+                return result_code::INCORRECT_STATE;
+            }
+            mRunning = true;
+            mShrinkTimeout = period / 4;
+            mThread = std::thread([this, period]() {
+                _run(period);
+            });
+            return result_code::SUCCEED;
+        }
+
+        void stop() {
+            {
+                lock_t lock(mMutex);
+                mRunning = false;
+            }
+            mCond.notify_all();
+            if (mThread.joinable() && mThread.get_id() != std::this_thread::get_id()) {
+                mThread.join();
+            }
+        }
+    private:
+        uint64_t _decide(const capacity_decision & d) {
+            uint64_t capacity = d.old_capacity;
+            if (mPolicy == capacity_policy::CAPACITY_AIMD) {
+                if (d.producer_blocked > mBlockThreshold) {
+                    capacity += mIncrease;
+                } else if (d.consumer_idle > mIdleThreshold && d.size < capacity / 2) {
+                    capacity = (uint64_t)(capacity * mDecrease);
+                }
+            } else {
+                mThroughput = mThroughput == 0
+                    ? d.throughput
+                    : mSmoothing * d.throughput + (1 - mSmoothing) * mThroughput;
+                capacity = (uint64_t)std::ceil(mThroughput * std::chrono::duration<double>(mTarget).count());
+            }
+            if (capacity < mMin) {
+                capacity = mMin;
+            }
+            if (capacity > mMax) {
+                capacity = mMax;
+            }
+            return capacity;
+        }
+
+        void _run(clock::duration period) {
+            lock_t lock(mMutex);
+            time_point next = clock::now() + period;
+            while (mRunning) {
+                if (mCond.wait_until(lock, next) != std::cv_status::timeout) {
+                    continue;
+                }
+                lock.unlock();
+                sample();
+                lock.lock();
+                next += period;
+            }
+        }
+    private:
+        _Queue & mQueue;
+        uint64_t mMin = 1;
+        uint64_t mMax = UINT64_MAX;
+        capacity_policy mPolicy = capacity_policy::CAPACITY_AIMD;
+        uint64_t mIncrease = 16;
+        double mDecrease = 0.5;
+        double mBlockThreshold = 0.05;
+        double mIdleThreshold = 0.5;
+        clock::duration mTarget = std::chrono::milliseconds(10);
+        double mSmoothing = 0.3;
+        double mThroughput = 0;
+        callback_t mCallback;
+
+        time_point mLastSample;
+        clock::duration mLastPushWait = clock::duration::zero();
+        clock::duration mLastPopWait = clock::duration::zero();
+        uint64_t mLastPops = 0;
+        clock::duration mShrinkTimeout = std::chrono::milliseconds(1);
+
+        mutex_t mMutex;
+        cond_t mCond;
+        bool mRunning = false;
+        std::thread mThread;
+    };
+}
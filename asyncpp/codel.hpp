@@ -0,0 +1,102 @@
+#pragma once
+
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+
+#include "asyncpp/timeout.hpp"
+
+namespace asyncpp
+{
+    enum aqm_mode {
+        //drop items from the head at dequeue
+        AQM_DROP_HEAD = 0,
+        //keep delivering, refuse pushes with REJECTED instead
+        AQM_REJECT_PUSH,
+    };
+
+    //CoDel control law (RFC 8289) driven by the sojourn time of dequeued items.
+    //once the sojourn time stayed above target for a whole interval it asks for
+    //a drop, then for further drops at interval / sqrt(count) spacing until
+    //the sojourn time falls below target again.
+    //all methods are called under the owning queue's lock, except dropping().
+    class codel
+    {
+    public:
+        codel() = default;
+        codel(const codel &) = delete;
+        codel & operator = (const codel &) = delete;
+    public:
+        void configure(clock::duration target, clock::duration interval) {
+            mTarget = target;
+            mInterval = interval;
+            reset();
+        }
+
+        void reset() {
+            mFirstAbove = time_point();
+            mDropNext = time_point();
+            mCount = 0;
+            mLastCount = 0;
+            mDropping.store(false, std::memory_order_relaxed);
+        }
+
+        bool dropping() const {
+            return mDropping.load(std::memory_order_relaxed);
+        }
+
+        //whether the item just taken from the head should be dropped.
+        //empty tells whether the queue is empty without it.
+        bool should_drop(time_point now, clock::duration sojourn, bool empty) {
+            bool ok = _ok_to_drop(now, sojourn, empty);
+            if (dropping()) {
+                if (!ok) {
+                    mDropping.store(false, std::memory_order_relaxed);
+                    return false;
+                }
+                if (now >= mDropNext) {
+                    ++mCount;
+                    mDropNext = _control_law(mDropNext);
+                    return true;
+                }
+                return false;
+            }
+            if (!ok) {
+                return false;
+            }
+            mDropping.store(true, std::memory_order_relaxed);
+            //resume near the previous drop rate if we just left dropping state
+            uint32_t delta = mCount - mLastCount;
+            mCount = (delta > 1 && now - mDropNext < 16 * mInterval) ? delta : 1;
+            mLastCount = mCount;
+            mDropNext = _control_law(now);
+            return true;
+        }
+    private:
+        bool _ok_to_drop(time_point now, clock::duration sojourn, bool empty) {
+            if (sojourn < mTarget || empty) {
+                mFirstAbove = time_point();
+                return false;
+            }
+            if (mFirstAbove == time_point()) {
+                mFirstAbove = now + mInterval;
+                return false;
+            }
+            return now >= mFirstAbove;
+        }
+
+        time_point _control_law(time_point t) const {
+            auto step = std::chrono::duration_cast<clock::duration>(
+                std::chrono::duration<double>(mInterval) / std::sqrt((double)mCount));
+            return t + step;
+        }
+    private:
+        clock::duration mTarget = std::chrono::milliseconds(5);
+        clock::duration mInterval = std::chrono::milliseconds(100);
+        time_point mFirstAbove;
+        time_point mDropNext;
+        uint32_t mCount = 0;
+        uint32_t mLastCount = 0;
+        std::atomic<bool> mDropping = false;
+    };
+}
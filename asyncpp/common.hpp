@@ -11,6 +11,7 @@ namespace asyncpp
         UNAVAILABLE_OR_TIMEOUT,
         DISABLED,
         BLOCKED,
+        REJECTED,
     };
 
 
@@ -0,0 +1,268 @@
+#pragma once
+
+#include <vector>
+#include <mutex>
+#include <functional>
+#include <cstdint>
+
+#include <asyncpp/common.hpp>
+#include <asyncpp/timeout.hpp>
+#include <asyncpp/pthread_wrapper.hpp>
+
+namespace asyncpp
+{
+    //keeps only the latest value per key: a push for a key already queued
+    //replaces the value in place, or merges into it with the merge function,
+    //and the key keeps its place in line. so at most one entry per distinct
+    //key waits, however far the consumers fall behind.
+    //pushes of new keys block while capacity keys are queued, pops block
+    //while none is; disable() wakes everyone up with DISABLED, like adv_queue.
+    //entries sit in a ring in push order, keys are found through an open
+    //addressing index with linear probing into that ring.
+    template<
+        typename _Key,
+        typename _Value,
+        typename _Hash = std::hash<_Key>,
+        template<bool> typename _Policy = sync_policy>
+    class conflating_queue
+    {
+    public:
+        conflating_queue() = default;
+        conflating_queue(const conflating_queue &) = delete;
+        conflating_queue & operator = (const conflating_queue &) = delete;
+    public:
+        using mutex_t = typename _Policy<false>::mutex_t;
+        using cond_t = typename _Policy<false>::cond_t;
+        using lock_t = typename _Policy<false>::lock_t;
+        //folds a newer value into the queued one
+        using merge_fn_t = std::function<void(_Value & queued, _Value && incoming)>;
+    public:
+        //manipulating functions:
+        result_code enable(uint32_t capacity) {
+            if (capacity == 0 || capacity > (UINT32_MAX >> 2)) {
+                return result_code::INVALID_ARGUMENTS;
+            }
+            lock_t lock(mMutex);
+            mRing = std::vector<entry>(capacity);
+            //at most half full keeps probe sequences short
+            uint32_t slots = 1;
+            while (slots < capacity * 2) {
+                slots <<= 1;
+            }
+            mIndex.assign(slots, 0);
+            mMask = slots - 1;
+            mHead = 0;
+            mCount = 0;
+            mConflated = 0;
+            mEnabled = true;
+            return result_code::SUCCEED;
+        }
+        result_code disable() {
+            lock_t lock(mMutex);
+            if (!mEnabled) {
+                return result_code::SUCCEED;
+            }
+            mEnabled = false;
+            mNotFull.notify_all();
+            mNotEmpty.notify_all();
+            return result_code::SUCCEED;
+        }
+        //replace is the default, set while no push runs
+        void set_merge(const merge_fn_t & merge) {
+            lock_t lock(mMutex);
+            mMerge = merge;
+        }
+
+        uint32_t get_capacity() const {
+            lock_t lock(mMutex);
+            return (uint32_t)mRing.size();
+        }
+        uint32_t get_size() const {
+            lock_t lock(mMutex);
+            return mCount;
+        }
+        //pushes absorbed by a queued entry since enable()
+        uint64_t get_conflated() const {
+            lock_t lock(mMutex);
+            return mConflated;
+        }
+
+        //data functions
+        result_code push(const _Key & key, const _Value & value, const timeout & to = timeout()) {
+            return push(key, _Value(value), to);
+        }
+        result_code push(const _Key & key, _Value && value, const timeout & to = timeout()) {
+            lock_t lock(mMutex);
+            while (true) {
+                if (!mEnabled) {
+                    return result_code::DISABLED;
+                }
+                //looked up again after every wait, the key may have come in
+                if (_conflate(key, value)) {
+                    return result_code::SUCCEED;
+                }
+                if (mCount < mRing.size()) {
+                    break;
+                }
+                if (to.has_value()) {
+                    if (mNotFull.wait_until(lock, to.value()) == std::cv_status::timeout
+                        && mEnabled && mCount == mRing.size() && _find(key) == UINT32_MAX) {
+                        return result_code::UNAVAILABLE_OR_TIMEOUT;
+                    }
+                } else {
+                    mNotFull.wait(lock);
+                }
+            }
+            _insert(key, std::move(value));
+            mNotEmpty.notify_one();
+            return result_code::SUCCEED;
+        }
+        result_code try_push(const _Key & key, const _Value & value) {
+            return try_push(key, _Value(value));
+        }
+        result_code try_push(const _Key & key, _Value && value) {
+            lock_t lock(mMutex);
+            if (!mEnabled) {
+                return result_code::DISABLED;
+            }
+            if (_conflate(key, value)) {
+                return result_code::SUCCEED;
+            }
+            if (mCount == mRing.size()) {
+                return result_code::UNAVAILABLE_OR_TIMEOUT;
+            }
+            _insert(key, std::move(value));
+            mNotEmpty.notify_one();
+            return result_code::SUCCEED;
+        }
+
+        result_code pop(_Key & key, _Value & value, const timeout & to = timeout()) {
+            lock_t lock(mMutex);
+            while (true) {
+                if (!mEnabled) {
+                    return result_code::DISABLED;
+                }
+                if (mCount > 0) {
+                    break;
+                }
+                if (to.has_value()) {
+                    if (mNotEmpty.wait_until(lock, to.value()) == std::cv_status::timeout
+                        && mEnabled && mCount == 0) {
+                        return result_code::UNAVAILABLE_OR_TIMEOUT;
+                    }
+                } else {
+                    mNotEmpty.wait(lock);
+                }
+            }
+            _remove(key, value);
+            mNotFull.notify_one();
+            return result_code::SUCCEED;
+        }
+        result_code try_pop(_Key & key, _Value & value) {
+            lock_t lock(mMutex);
+            if (!mEnabled) {
+                return result_code::DISABLED;
+            }
+            if (mCount == 0) {
+                return result_code::UNAVAILABLE_OR_TIMEOUT;
+            }
+            _remove(key, value);
+            mNotFull.notify_one();
+            return result_code::SUCCEED;
+        }
+
+    private:
+        struct entry
+        {
+            _Key key{};
+            _Value value{};
+        };
+
+        inline uint32_t _home(const _Key & key) const {
+            return (uint32_t)mHash(key) & mMask;
+        }
+        inline uint32_t _slot(uint32_t pos) const {
+            pos += mHead;
+            return pos >= mRing.size() ? pos - (uint32_t)mRing.size() : pos;
+        }
+
+        //the index position holding key, UINT32_MAX if not queued.
+        //index entries are ring slot + 1, 0 is empty
+        uint32_t _find(const _Key & key) const {
+            for (uint32_t i = _home(key); mIndex[i] != 0; i = (i + 1) & mMask) {
+                if (mRing[mIndex[i] - 1].key == key) {
+                    return i;
+                }
+            }
+            return UINT32_MAX;
+        }
+
+        bool _conflate(const _Key & key, _Value & value) {
+            uint32_t i = _find(key);
+            if (i == UINT32_MAX) {
+                return false;
+            }
+            _Value & queued = mRing[mIndex[i] - 1].value;
+            if (mMerge != nullptr) {
+                mMerge(queued, std::move(value));
+            } else {
+                queued = std::move(value);
+            }
+            ++mConflated;
+            return true;
+        }
+
+        void _insert(const _Key & key, _Value && value) {
+            uint32_t slot = _slot(mCount);
+            mRing[slot].key = key;
+            mRing[slot].value = std::move(value);
+            uint32_t i = _home(key);
+            while (mIndex[i] != 0) {
+                i = (i + 1) & mMask;
+            }
+            mIndex[i] = slot + 1;
+            ++mCount;
+        }
+
+        void _remove(_Key & key, _Value & value) {
+            entry & head = mRing[mHead];
+            _erase(_find(head.key));
+            key = std::move(head.key);
+            value = std::move(head.value);
+            mHead = _slot(1);
+            --mCount;
+        }
+
+        //backward shift deletion: entries after the hole move up unless
+        //that would put them before their home position, no tombstones
+        void _erase(uint32_t hole) {
+            uint32_t i = hole;
+            while (true) {
+                i = (i + 1) & mMask;
+                if (mIndex[i] == 0) {
+                    break;
+                }
+                uint32_t home = _home(mRing[mIndex[i] - 1].key);
+                //moves when home is not cyclically within (hole, i]
+                if (((i - home) & mMask) >= ((i - hole) & mMask)) {
+                    mIndex[hole] = mIndex[i];
+                    hole = i;
+                }
+            }
+            mIndex[hole] = 0;
+        }
+    private:
+        mutable mutex_t mMutex;
+        cond_t mNotFull;
+        cond_t mNotEmpty;
+        bool mEnabled = false;
+        std::vector<entry> mRing;
+        std::vector<uint32_t> mIndex;
+        uint32_t mMask = 0;
+        uint32_t mHead = 0;
+        uint32_t mCount = 0;
+        uint64_t mConflated = 0;
+        merge_fn_t mMerge;
+        _Hash mHash;
+    };
+}
@@ -0,0 +1,298 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "asyncpp/common.hpp"
+#include "asyncpp/timeout.hpp"
+#include "asyncpp/wait_list.hpp"
+
+namespace asyncpp
+{
+    //delivers the items of many queues to handlers on a shared set of
+    //workers, in place of a thread blocked in pop() per queue.
+    //a queue is scheduled when its wait_node fires and then drained by one
+    //worker at a time, so a handler is never run concurrently with itself
+    //and items reach it in queue order. a worker takes items in batches and
+    //gives the queue up after quantum items, behind every other queue
+    //that is scheduled. handlers should not block, they hold a worker.
+    //works with queues that have attach()/detach() and try_pop_batch(), i.e.
+    //in-process adv_queue and basic_queue, which must outlive their
+    //registration. a queue found disabled is left alone until removed.
+    class dispatcher
+    {
+    public:
+        dispatcher() = default;
+        dispatcher(const dispatcher &) = delete;
+        dispatcher & operator = (const dispatcher &) = delete;
+        ~dispatcher() {
+            stop();
+            std::list<std::unique_ptr<channel>> channels;
+            {
+                lock_t lock(mMutex);
+                channels.swap(mChannels);
+            }
+            for (auto & c : channels) {
+                c->detach();
+            }
+        }
+    public:
+        using lock_t = std::unique_lock<std::mutex>;
+        class channel;
+        //identifies a registered queue for remove()
+        using handle = channel *;
+    public:
+        //quantum: items a queue is served before the next scheduled one.
+        //batch: items taken from the queue at once
+        result_code start(uint32_t workers, uint32_t quantum = 64, uint32_t batch = 16) {
+            if (workers == 0 || quantum == 0 || batch == 0) {
+                return result_code::INVALID_ARGUMENTS;
+            }
+            lock_t lock(mMutex);
+            if (!mWorkers.empty()) {
+                return result_code::INCORRECT_STATE;
+            }
+            mQuantum = quantum;
+            mBatch = batch < quantum ? batch : quantum;
+            mStopping = false;
+            for (uint32_t i = 0; i < workers; ++i) {
+                mWorkers.emplace_back([this] {
+                    _work();
+                });
+            }
+            return result_code::SUCCEED;
+        }
+        //waits for the running handlers, scheduled queues stay scheduled
+        //and are served after the next start()
+        void stop() {
+            std::vector<std::thread> workers;
+            {
+                lock_t lock(mMutex);
+                mStopping = true;
+                workers.swap(mWorkers);
+                mRunnable.notify_all();
+            }
+            for (auto & t : workers) {
+                t.join();
+            }
+        }
+
+        //handler is called with every item popped from queue, an rvalue
+        template<typename _Queue, typename _Handler>
+        result_code add(_Queue & queue, _Handler && handler, handle * h = nullptr) {
+            auto c = std::make_unique<queue_channel<_Queue, std::decay_t<_Handler>>>(
+                this, queue, std::forward<_Handler>(handler));
+            handle added = c.get();
+            {
+                lock_t lock(mMutex);
+                mChannels.push_back(std::move(c));
+            }
+            added->attach();
+            //items queued before attaching raised no notification
+            _schedule(added);
+            if (h != nullptr) {
+                *h = added;
+            }
+            return result_code::SUCCEED;
+        }
+        //after it returns the handler is not running and won't be called again
+        result_code remove(handle h) {
+            h->detach();
+            lock_t lock(mMutex);
+            auto it = mChannels.begin();
+            while (it != mChannels.end() && it->get() != h) {
+                ++it;
+            }
+            if (it == mChannels.end()) {
+                return result_code::INVALID_ARGUMENTS;
+            }
+            h->mRemoved = true;
+            mIdle.wait(lock, [h] {
+                return h->mState.load(std::memory_order_acquire) != RUNNING
+                    && h->mState.load(std::memory_order_acquire) != RUNNING_NOTIFIED;
+            });
+            for (auto r = mRunQueue.begin(); r != mRunQueue.end(); ++r) {
+                if (*r == h) {
+                    mRunQueue.erase(r);
+                    break;
+                }
+            }
+            mChannels.erase(it);
+            return result_code::SUCCEED;
+        }
+
+        //items handed to handlers so far
+        uint64_t get_dispatched() const {
+            return mDispatched.load(std::memory_order_relaxed);
+        }
+    public:
+        enum state : uint32_t {
+            IDLE = 0,
+            SCHEDULED,
+            RUNNING,
+            //notified while running, drained again before going idle
+            RUNNING_NOTIFIED,
+            //the queue was disabled
+            CLOSED,
+        };
+
+        enum drain_result {
+            DRAIN_EMPTY = 0,
+            DRAIN_MORE,
+            DRAIN_CLOSED,
+        };
+
+        class channel
+        {
+            friend class dispatcher;
+        public:
+            channel(dispatcher * owner) : mOwner(owner) {
+                mNode.notify = &channel::_notify;
+                mNode.context = this;
+            }
+            channel(const channel &) = delete;
+            channel & operator = (const channel &) = delete;
+            virtual ~channel() = default;
+        protected:
+            virtual void attach() = 0;
+            virtual void detach() = 0;
+            //hands up to quantum items to the handler
+            virtual drain_result drain(uint32_t quantum, uint32_t batch, uint64_t & handled) = 0;
+        private:
+            //runs under the queue's lock, takes the dispatcher's
+            static void _notify(void * context) {
+                channel * c = static_cast<channel *>(context);
+                c->mOwner->_schedule(c);
+            }
+        protected:
+            wait_node mNode;
+        private:
+            dispatcher * mOwner;
+            std::atomic<uint32_t> mState = IDLE;
+            bool mRemoved = false;
+        };
+
+    private:
+        template<typename _Queue, typename _Handler>
+        class queue_channel : public channel
+        {
+        public:
+            template<typename _H>
+            queue_channel(dispatcher * owner, _Queue & queue, _H && handler)
+                : channel(owner), mQueue(queue), mHandler(std::forward<_H>(handler)) {}
+        protected:
+            void attach() override {
+                mQueue.attach(mNode);
+            }
+            void detach() override {
+                mQueue.detach(mNode);
+            }
+            drain_result drain(uint32_t quantum, uint32_t batch, uint64_t & handled) override {
+                while (handled < quantum) {
+                    uint32_t want = quantum - handled < batch ? quantum - (uint32_t)handled : batch;
+                    mItems.clear();
+                    result_code res = mQueue.try_pop_batch(mItems, want);
+                    if (res == result_code::DISABLED) {
+                        return DRAIN_CLOSED;
+                    }
+                    if (res != result_code::SUCCEED) {
+                        return DRAIN_EMPTY;
+                    }
+                    for (auto & item : mItems) {
+                        mHandler(std::move(item));
+                    }
+                    handled += mItems.size();
+                }
+                return DRAIN_MORE;
+            }
+        private:
+            _Queue & mQueue;
+            _Handler mHandler;
+            std::vector<typename _Queue::item_type> mItems;
+        };
+
+        void _schedule(channel * c) {
+            uint32_t s = c->mState.load(std::memory_order_acquire);
+            while (true) {
+                if (s == IDLE) {
+                    if (c->mState.compare_exchange_weak(s, SCHEDULED, std::memory_order_acq_rel)) {
+                        lock_t lock(mMutex);
+                        mRunQueue.push_back(c);
+                        mRunnable.notify_one();
+                        return;
+                    }
+                } else if (s == RUNNING) {
+                    if (c->mState.compare_exchange_weak(s, RUNNING_NOTIFIED, std::memory_order_acq_rel)) {
+                        return;
+                    }
+                } else {
+                    return;
+                }
+            }
+        }
+
+        void _work() {
+            lock_t lock(mMutex);
+            while (true) {
+                mRunnable.wait(lock, [this] {
+                    return mStopping || !mRunQueue.empty();
+                });
+                if (mStopping) {
+                    return;
+                }
+                channel * c = mRunQueue.front();
+                mRunQueue.pop_front();
+                if (c->mRemoved) {
+                    continue;
+                }
+                c->mState.store(RUNNING, std::memory_order_release);
+                lock.unlock();
+                drain_result res = DRAIN_EMPTY;
+                uint64_t handled = 0;
+                while (true) {
+                    res = c->drain(mQuantum, mBatch, handled);
+                    if (res != DRAIN_EMPTY) {
+                        break;
+                    }
+                    //an item that came after the last look notified us
+                    uint32_t s = RUNNING;
+                    if (c->mState.compare_exchange_strong(s, IDLE, std::memory_order_acq_rel)) {
+                        break;
+                    }
+                    c->mState.store(RUNNING, std::memory_order_release);
+                }
+                mDispatched.fetch_add(handled, std::memory_order_relaxed);
+                lock.lock();
+                if (res == DRAIN_MORE) {
+                    //served its quantum, back in line behind the others
+                    c->mState.store(SCHEDULED, std::memory_order_release);
+                    if (!c->mRemoved) {
+                        mRunQueue.push_back(c);
+                    }
+                } else if (res == DRAIN_CLOSED) {
+                    c->mState.store(CLOSED, std::memory_order_release);
+                }
+                mIdle.notify_all();
+            }
+        }
+    private:
+        std::mutex mMutex;
+        std::condition_variable mRunnable;
+        std::condition_variable mIdle;
+        std::deque<channel *> mRunQueue;
+        std::list<std::unique_ptr<channel>> mChannels;
+        std::vector<std::thread> mWorkers;
+        bool mStopping = false;
+        uint32_t mQuantum = 64;
+        uint32_t mBatch = 16;
+        std::atomic<uint64_t> mDispatched = 0;
+    };
+}
@@ -0,0 +1,152 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+#include "asyncpp/common.hpp"
+#include "asyncpp/timeout.hpp"
+#include "asyncpp/futex.hpp"
+#include "asyncpp/pthread_wrapper.hpp"
+
+namespace asyncpp
+{
+    //lets lock free code park until a condition holds, with no mutex.
+    //a waiter announces itself, checks the condition again and only then
+    //sleeps on the epoch it saw:
+    //
+    //  while (!ready()) {
+    //      auto key = ec.prepare_wait();
+    //      if (ready()) {
+    //          ec.cancel_wait();
+    //          break;
+    //      }
+    //      ec.commit_wait(key);
+    //  }
+    //
+    //whoever makes the condition true stores the change, then notifies.
+    //notifying is a fence and a load while nobody waits.
+    //also a wait strategy, see wait_strategy.hpp
+    template<bool _InterProcess = false>
+    class event_count
+    {
+    public:
+        using key_t = uint32_t;
+    public:
+        event_count() = default;
+        event_count(const event_count &) = delete;
+        event_count & operator = (const event_count &) = delete;
+    public:
+        key_t prepare_wait() {
+            //pairs with the fence in _notify(), either the notifier sees
+            //the waiter or the waiter's second look sees the change
+            mWaiters.fetch_add(1, std::memory_order_seq_cst);
+            return mEpoch.load(std::memory_order_seq_cst);
+        }
+        void cancel_wait() {
+            mWaiters.fetch_sub(1, std::memory_order_relaxed);
+        }
+        //sleeps until a notify after prepare_wait() returned key
+        result_code commit_wait(key_t key, const timeout & to = timeout()) {
+            result_code res = result_code::SUCCEED;
+            while (mEpoch.load(std::memory_order_acquire) == key) {
+                if (futex<_InterProcess>::wait(mEpoch, key, to) == result_code::UNAVAILABLE_OR_TIMEOUT) {
+                    if (mEpoch.load(std::memory_order_acquire) == key) {
+                        res = result_code::UNAVAILABLE_OR_TIMEOUT;
+                    }
+                    break;
+                }
+            }
+            mWaiters.fetch_sub(1, std::memory_order_relaxed);
+            return res;
+        }
+
+        void notify_one() {
+            _notify(1);
+        }
+        void notify_all() {
+            _notify(INT_MAX);
+        }
+
+        //wait strategy interface
+        template<typename _Pred>
+        result_code wait(const _Pred & ready, const timeout & to = timeout()) {
+            while (!ready()) {
+                key_t key = prepare_wait();
+                if (ready()) {
+                    cancel_wait();
+                    break;
+                }
+                if (commit_wait(key, to) != result_code::SUCCEED) {
+                    return ready() ? result_code::SUCCEED : result_code::UNAVAILABLE_OR_TIMEOUT;
+                }
+            }
+            return result_code::SUCCEED;
+        }
+        void notify() {
+            notify_all();
+        }
+    private:
+        void _notify(int count) {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (mWaiters.load(std::memory_order_relaxed) == 0) {
+                return;
+            }
+            mEpoch.fetch_add(1, std::memory_order_seq_cst);
+            futex<_InterProcess>::wake(mEpoch, count);
+        }
+    private:
+        std::atomic<uint32_t> mEpoch = 0;
+        std::atomic<uint32_t> mWaiters = 0;
+    };
+
+    //a condition variable on an event_count, for the primitives' _Policy.
+    //works with any lock and in shared memory, and a notify with nobody
+    //waiting stays in user space
+    template<bool _InterProcess = false>
+    class event_cond
+    {
+    public:
+        event_cond() = default;
+        event_cond(const event_cond &) = delete;
+        event_cond & operator = (const event_cond &) = delete;
+    public:
+        template<typename _Lock>
+        void wait(_Lock & lock) {
+            auto key = mEvents.prepare_wait();
+            lock.unlock();
+            mEvents.commit_wait(key);
+            lock.lock();
+        }
+        template<typename _Lock, typename _Clock, typename _Duration>
+        std::cv_status wait_until(_Lock & lock, const std::chrono::time_point<_Clock, _Duration> & until) {
+            auto key = mEvents.prepare_wait();
+            lock.unlock();
+            auto left = std::chrono::duration_cast<clock::duration>(until - _Clock::now());
+            mEvents.commit_wait(key, timeout(clock::now() + left));
+            lock.lock();
+            return _Clock::now() >= until ? std::cv_status::timeout : std::cv_status::no_timeout;
+        }
+        void notify_one() {
+            mEvents.notify_one();
+        }
+        void notify_all() {
+            mEvents.notify_all();
+        }
+    private:
+        event_count<_InterProcess> mEvents;
+    };
+
+    //the default mutexes with event_cond in place of the pthread condvars,
+    //e.g. adv_semaphore<false, uint32_t, event_policy>
+    template<bool _InterProcess = false>
+    struct event_policy
+    {
+        using mutex_t = asyncpp::mutex<_InterProcess>;
+        using cond_t = event_cond<_InterProcess>;
+        using lock_t = std::unique_lock<std::mutex>;
+    };
+}
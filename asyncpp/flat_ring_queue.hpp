@@ -10,6 +10,7 @@ namespace asyncpp
     class flat_ring_queue
     {
     public:
+        using value_type = _Item;
         std::size_t size() const {
             return mBack >= mFront ? (mBack - mFront) : (mBack + _Cap - mFront);
         }
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <time.h>
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+
+#include "asyncpp/common.hpp"
+#include "asyncpp/timeout.hpp"
+
+namespace asyncpp
+{
+    //thin wrappers over the futex syscall for primitives that keep their
+    //whole state in one 32 bit word. _InterProcess words may live in shared
+    //memory, the others use the cheaper private futexes.
+    template<bool _InterProcess = false>
+    struct futex
+    {
+        static constexpr int private_flag = _InterProcess ? 0 : FUTEX_PRIVATE_FLAG;
+
+        //sleeps while word == expected. returns SUCCEED on wake up, spurious
+        //or not, and UNAVAILABLE_OR_TIMEOUT once the timeout passed
+        static result_code wait(std::atomic<uint32_t> & word, uint32_t expected, const timeout & to = timeout()) {
+            struct timespec ts;
+            struct timespec * pts = nullptr;
+            if (to.has_value()) {
+                auto left = to.value() - clock::now();
+                if (left <= clock::duration::zero()) {
+                    return result_code::UNAVAILABLE_OR_TIMEOUT;
+                }
+                auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(left).count();
+                ts.tv_sec = (time_t)(ns / 1000000000);
+                ts.tv_nsec = (long)(ns % 1000000000);
+                pts = &ts;
+            }
+            long res = syscall(SYS_futex, reinterpret_cast<uint32_t *>(&word),
+                FUTEX_WAIT | private_flag, expected, pts, nullptr, 0);
+            if (res != 0 && errno == ETIMEDOUT) {
+                return result_code::UNAVAILABLE_OR_TIMEOUT;
+            }
+            return result_code::SUCCEED;
+        }
+
+        static void wake(std::atomic<uint32_t> & word, int count = INT_MAX) {
+            syscall(SYS_futex, reinterpret_cast<uint32_t *>(&word),
+                FUTEX_WAKE | private_flag, count, nullptr, nullptr, 0);
+        }
+    };
+}
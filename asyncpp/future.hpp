@@ -0,0 +1,400 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "asyncpp/common.hpp"
+#include "asyncpp/timeout.hpp"
+#include "asyncpp/futex.hpp"
+
+namespace asyncpp
+{
+    //an executor is anything with execute(fn) taking a move-only callable.
+    //this one runs the continuation right away on the thread that completed
+    //the future, or on the thread calling then() if it already was.
+    struct inline_executor
+    {
+        template<typename _Fn>
+        void execute(_Fn && fn) {
+            fn();
+        }
+    };
+
+    template<typename _T>
+    class future;
+    template<typename _T>
+    class promise;
+
+    //the state shared by a promise and its future.
+    //one allocation per pair, the value and a continuation of up to
+    //inline_size bytes live inside it. fulfilling is a single atomic
+    //or on the state word and only enters the kernel when get() sleeps.
+    template<typename _T>
+    class future_state
+    {
+    public:
+        static constexpr std::size_t inline_size = 64;
+        enum : uint32_t {
+            VALUE = 1,
+            //the promise went away without a value
+            BROKEN = 2,
+            CONTINUATION = 4,
+            WAITING = 8,
+        };
+    public:
+        future_state() = default;
+        future_state(const future_state &) = delete;
+        future_state & operator = (const future_state &) = delete;
+    public:
+        void release() {
+            if (mRefs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                delete this;
+            }
+        }
+
+        bool ready() const {
+            return (mState.load(std::memory_order_acquire) & (VALUE | BROKEN)) != 0;
+        }
+        bool has_value() const {
+            return (mState.load(std::memory_order_acquire) & VALUE) != 0;
+        }
+        std::optional<_T> & value() {
+            return mValue;
+        }
+
+        template<typename ..._Args>
+        void fulfil(_Args && ...args) {
+            mValue.emplace(std::forward<_Args>(args)...);
+            _complete(VALUE);
+        }
+        void abandon() {
+            _complete(BROKEN);
+        }
+
+        result_code wait(const timeout & to) {
+            uint32_t state = mState.load(std::memory_order_acquire);
+            while ((state & (VALUE | BROKEN)) == 0) {
+                if ((state & WAITING) == 0) {
+                    if (!mState.compare_exchange_weak(state, state | WAITING, std::memory_order_acquire)) {
+                        continue;
+                    }
+                    state |= WAITING;
+                }
+                if (futex<>::wait(mState, state, to) == result_code::UNAVAILABLE_OR_TIMEOUT) {
+                    if (!ready()) {
+                        return result_code::UNAVAILABLE_OR_TIMEOUT;
+                    }
+                }
+                state = mState.load(std::memory_order_acquire);
+            }
+            return result_code::SUCCEED;
+        }
+
+        //fn(future_state &) runs exactly once, when the state is ready
+        template<typename _Fn>
+        void attach(_Fn && fn) {
+            using fn_t = typename std::decay<_Fn>::type;
+            if constexpr (sizeof(fn_t) <= inline_size && alignof(fn_t) <= alignof(std::max_align_t)) {
+                new (mStorage) fn_t(std::forward<_Fn>(fn));
+                mContinuation = [](future_state & s) {
+                    fn_t & f = *std::launder(reinterpret_cast<fn_t *>(s.mStorage));
+                    f(s);
+                    f.~fn_t();
+                };
+            } else {
+                new (mStorage) fn_t *(new fn_t(std::forward<_Fn>(fn)));
+                mContinuation = [](future_state & s) {
+                    fn_t * f = *std::launder(reinterpret_cast<fn_t **>(s.mStorage));
+                    (*f)(s);
+                    delete f;
+                };
+            }
+            uint32_t prev = mState.fetch_or(CONTINUATION, std::memory_order_acq_rel);
+            if ((prev & (VALUE | BROKEN)) != 0) {
+                mContinuation(*this);
+            }
+        }
+    private:
+        //whoever comes second of the value and the continuation runs it
+        void _complete(uint32_t flag) {
+            uint32_t prev = mState.fetch_or(flag, std::memory_order_acq_rel);
+            if ((prev & CONTINUATION) != 0) {
+                mContinuation(*this);
+            }
+            if ((prev & WAITING) != 0) {
+                futex<>::wake(mState);
+            }
+        }
+    private:
+        std::atomic<uint32_t> mState = 0;
+        std::atomic<uint32_t> mRefs = 2;
+        std::optional<_T> mValue;
+        void (*mContinuation)(future_state &) = nullptr;
+        alignas(std::max_align_t) unsigned char mStorage[inline_size];
+    };
+
+    template<typename _T>
+    class future
+    {
+        friend class promise<_T>;
+        template<typename _U>
+        friend class future;
+    public:
+        using value_type = _T;
+    public:
+        future() = default;
+        future(const future &) = delete;
+        future & operator = (const future &) = delete;
+        future(future && other) : mState(other.mState) {
+            other.mState = nullptr;
+        }
+        future & operator = (future && other) {
+            if (this != &other) {
+                _reset();
+                mState = other.mState;
+                other.mState = nullptr;
+            }
+            return *this;
+        }
+        ~future() {
+            _reset();
+        }
+    public:
+        bool valid() const {
+            return mState != nullptr;
+        }
+        bool is_ready() const {
+            return mState != nullptr && mState->ready();
+        }
+
+        result_code wait(const timeout & to = timeout()) {
+            if (mState == nullptr) {
+                return result_code::INCORRECT_STATE;
+            }
+            return mState->wait(to);
+        }
+
+        //moves the value out, the future is consumed on success.
+        //DISABLED when the promise was dropped without a value
+        result_code get(_T & value, const timeout & to = timeout()) {
+            result_code res = wait(to);
+            if (res != result_code::SUCCEED) {
+                return res;
+            }
+            if (!mState->has_value()) {
+                _reset();
+                return result_code::DISABLED;
+            }
+            value = std::move(*mState->value());
+            _reset();
+            return result_code::SUCCEED;
+        }
+
+        //fn(_T &&) runs on exec once the value is there, its result
+        //completes the returned future. a broken future breaks the chain
+        //without calling fn. exec must outlive the continuation.
+        template<typename _Exec, typename _Fn>
+        auto then(_Exec & exec, _Fn && fn) {
+            using result_t = typename std::decay<typename std::invoke_result<_Fn &, _T &&>::type>::type;
+            static_assert(!std::is_void<result_t>::value, "continuations return a value");
+            promise<result_t> next;
+            future<result_t> result = next.get_future();
+            if (mState == nullptr) {
+                return result;
+            }
+            mState->attach([exec = &exec, fn = std::forward<_Fn>(fn), next = std::move(next)](
+                    future_state<_T> & s) mutable {
+                if (!s.has_value()) {
+                    return;
+                }
+                exec->execute([fn = std::move(fn), value = std::move(*s.value()), next = std::move(next)]() mutable {
+                    next.set_value(fn(std::move(value)));
+                });
+            });
+            _reset();
+            return result;
+        }
+        template<typename _Fn>
+        auto then(_Fn && fn) {
+            static inline_executor exec;
+            return then(exec, std::forward<_Fn>(fn));
+        }
+
+        //fn(future_state<_T> &) runs once when ready, for combinators
+        template<typename _Fn>
+        result_code on_ready(_Fn && fn) {
+            if (mState == nullptr) {
+                return result_code::INCORRECT_STATE;
+            }
+            mState->attach(std::forward<_Fn>(fn));
+            _reset();
+            return result_code::SUCCEED;
+        }
+    private:
+        explicit future(future_state<_T> * state) : mState(state) {}
+        void _reset() {
+            if (mState != nullptr) {
+                mState->release();
+                mState = nullptr;
+            }
+        }
+    private:
+        future_state<_T> * mState = nullptr;
+    };
+
+    template<typename _T>
+    class promise
+    {
+    public:
+        promise() : mState(new future_state<_T>()) {}
+        promise(const promise &) = delete;
+        promise & operator = (const promise &) = delete;
+        promise(promise && other) : mState(other.mState), mRetrieved(other.mRetrieved) {
+            other.mState = nullptr;
+        }
+        promise & operator = (promise && other) {
+            if (this != &other) {
+                _reset();
+                mState = other.mState;
+                mRetrieved = other.mRetrieved;
+                other.mState = nullptr;
+            }
+            return *this;
+        }
+        //an unfulfilled promise breaks its future
+        ~promise() {
+            _reset();
+        }
+    public:
+        //only once per promise
+        future<_T> get_future() {
+            if (mState == nullptr || mRetrieved) {
+                return future<_T>();
+            }
+            mRetrieved = true;
+            return future<_T>(mState);
+        }
+
+        template<typename ..._Args>
+        result_code set_value(_Args && ...args) {
+            if (mState == nullptr) {
+                return result_code::INCORRECT_STATE;
+            }
+            //the waiter may free this promise as soon as the value is in,
+            //nothing of it is touched after fulfil()
+            future_state<_T> * state = mState;
+            bool retrieved = mRetrieved;
+            mState = nullptr;
+            state->fulfil(std::forward<_Args>(args)...);
+            _release(state, retrieved);
+            return result_code::SUCCEED;
+        }
+    private:
+        void _reset() {
+            if (mState != nullptr) {
+                future_state<_T> * state = mState;
+                bool retrieved = mRetrieved;
+                mState = nullptr;
+                state->abandon();
+                _release(state, retrieved);
+            }
+        }
+        //the future's reference is dropped here too if it was never taken
+        static void _release(future_state<_T> * state, bool retrieved) {
+            if (!retrieved) {
+                state->release();
+            }
+            state->release();
+        }
+    private:
+        future_state<_T> * mState;
+        bool mRetrieved = false;
+    };
+
+    template<typename _T>
+    future<typename std::decay<_T>::type> make_ready_future(_T && value) {
+        promise<typename std::decay<_T>::type> p;
+        auto f = p.get_future();
+        p.set_value(std::forward<_T>(value));
+        return f;
+    }
+
+    //completes with all the values in order once every future did,
+    //breaks if any of them broke
+    template<typename _T>
+    future<std::vector<_T>> when_all(std::vector<future<_T>> && futures) {
+        struct context
+        {
+            promise<std::vector<_T>> done;
+            std::vector<std::optional<_T>> values;
+            std::atomic<std::size_t> left;
+            std::atomic<bool> broken = false;
+        };
+        auto ctx = std::make_shared<context>();
+        auto result = ctx->done.get_future();
+        ctx->values.resize(futures.size());
+        ctx->left = futures.size();
+        if (futures.empty()) {
+            ctx->done.set_value();
+            return result;
+        }
+        for (std::size_t i = 0; i < futures.size(); ++i) {
+            auto on_ready = [ctx, i](future_state<_T> & s) {
+                if (s.has_value()) {
+                    ctx->values[i] = std::move(*s.value());
+                } else {
+                    ctx->broken.store(true, std::memory_order_relaxed);
+                }
+                if (ctx->left.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+                    return;
+                }
+                //a promise left unset breaks once ctx goes away
+                if (ctx->broken.load(std::memory_order_relaxed)) {
+                    return;
+                }
+                std::vector<_T> values;
+                values.reserve(ctx->values.size());
+                for (auto & v : ctx->values) {
+                    values.emplace_back(std::move(*v));
+                }
+                ctx->done.set_value(std::move(values));
+            };
+            if (futures[i].on_ready(on_ready) != result_code::SUCCEED) {
+                //an invalid future counts as broken
+                ctx->broken.store(true, std::memory_order_relaxed);
+                ctx->left.fetch_sub(1, std::memory_order_acq_rel);
+            }
+        }
+        return result;
+    }
+
+    //completes with the index and value of the first future that got one,
+    //breaks only if all of them broke
+    template<typename _T>
+    future<std::pair<std::size_t, _T>> when_any(std::vector<future<_T>> && futures) {
+        //without a winner the promise is left unset and breaks once the
+        //last continuation lets go of ctx
+        struct context
+        {
+            promise<std::pair<std::size_t, _T>> done;
+            std::atomic<bool> won = false;
+        };
+        auto ctx = std::make_shared<context>();
+        auto result = ctx->done.get_future();
+        for (std::size_t i = 0; i < futures.size(); ++i) {
+            futures[i].on_ready([ctx, i](future_state<_T> & s) {
+                if (s.has_value() && !ctx->won.exchange(true, std::memory_order_acq_rel)) {
+                    ctx->done.set_value(i, std::move(*s.value()));
+                }
+            });
+        }
+        return result;
+    }
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <atomic>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace asyncpp
+{
+    //log-linear histogram in the style of HdrHistogram.
+    //every power of two is split into 2^_SubBits linear buckets, so values
+    //are kept with a relative error below 2^-_SubBits over the whole 64 bit
+    //range. recording is a relaxed atomic add, a thread may keep its own
+    //histogram and merge() it into a shared one from time to time.
+    template<uint32_t _SubBits = 5>
+    class basic_histogram
+    {
+        static_assert(_SubBits > 0 && _SubBits < 16, "unreasonable precision");
+    public:
+        basic_histogram() = default;
+        basic_histogram(const basic_histogram &) = delete;
+        basic_histogram & operator = (const basic_histogram &) = delete;
+    public:
+        static constexpr std::size_t sub_count = (std::size_t)1 << _SubBits;
+        static constexpr std::size_t bucket_count = (65 - _SubBits) * sub_count;
+    public:
+        void record(uint64_t value) {
+            mBuckets[_index(value)].fetch_add(1, std::memory_order_relaxed);
+            mCount.fetch_add(1, std::memory_order_relaxed);
+            mSum.fetch_add(value, std::memory_order_relaxed);
+            uint64_t max = mMax.load(std::memory_order_relaxed);
+            while (value > max && !mMax.compare_exchange_weak(max, value, std::memory_order_relaxed)) {
+            }
+        }
+
+        void merge(const basic_histogram & other) {
+            for (std::size_t i = 0; i < bucket_count; ++i) {
+                uint64_t n = other.mBuckets[i].load(std::memory_order_relaxed);
+                if (n != 0) {
+                    mBuckets[i].fetch_add(n, std::memory_order_relaxed);
+                }
+            }
+            mCount.fetch_add(other.get_count(), std::memory_order_relaxed);
+            mSum.fetch_add(other.mSum.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            uint64_t value = other.get_max();
+            uint64_t max = mMax.load(std::memory_order_relaxed);
+            while (value > max && !mMax.compare_exchange_weak(max, value, std::memory_order_relaxed)) {
+            }
+        }
+
+        //not atomic with respect to concurrent record()
+        void reset() {
+            for (auto & bucket : mBuckets) {
+                bucket.store(0, std::memory_order_relaxed);
+            }
+            mCount.store(0, std::memory_order_relaxed);
+            mSum.store(0, std::memory_order_relaxed);
+            mMax.store(0, std::memory_order_relaxed);
+        }
+
+        uint64_t get_count() const {
+            return mCount.load(std::memory_order_relaxed);
+        }
+        uint64_t get_max() const {
+            return mMax.load(std::memory_order_relaxed);
+        }
+        uint64_t get_mean() const {
+            uint64_t count = get_count();
+            return count == 0 ? 0 : mSum.load(std::memory_order_relaxed) / count;
+        }
+
+        //the value below which a fraction q of the records fall, q in [0, 1]
+        uint64_t get_percentile(double q) const {
+            uint64_t count = get_count();
+            if (count == 0) {
+                return 0;
+            }
+            uint64_t rank = (uint64_t)(q * count + 0.5);
+            if (rank == 0) {
+                rank = 1;
+            }
+            uint64_t seen = 0;
+            for (std::size_t i = 0; i < bucket_count; ++i) {
+                seen += mBuckets[i].load(std::memory_order_relaxed);
+                if (seen >= rank) {
+                    uint64_t value = _highest(i);
+                    uint64_t max = get_max();
+                    return value < max ? value : max;
+                }
+            }
+            return get_max();
+        }
+        uint64_t p50() const {
+            return get_percentile(0.5);
+        }
+        uint64_t p99() const {
+            return get_percentile(0.99);
+        }
+        uint64_t p999() const {
+            return get_percentile(0.999);
+        }
+    private:
+        static std::size_t _index(uint64_t value) {
+            if (value < sub_count) {
+                return (std::size_t)value;
+            }
+            uint32_t shift = 63 - __builtin_clzll(value) - _SubBits;
+            return (shift + 1) * sub_count + (std::size_t)((value >> shift) - sub_count);
+        }
+        //the largest value that maps to bucket index
+        static uint64_t _highest(std::size_t index) {
+            if (index < sub_count) {
+                return index;
+            }
+            uint32_t shift = (uint32_t)(index / sub_count) - 1;
+            uint64_t sub = index % sub_count + sub_count;
+            return ((sub + 1) << shift) - 1;
+        }
+    private:
+        std::array<std::atomic<uint64_t>, bucket_count> mBuckets = {};
+        std::atomic<uint64_t> mCount = 0;
+        std::atomic<uint64_t> mSum = 0;
+        std::atomic<uint64_t> mMax = 0;
+    };
+
+    using latency_histogram = basic_histogram<>;
+}
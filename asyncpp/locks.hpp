@@ -0,0 +1,270 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+#include "asyncpp/common.hpp"
+#include "asyncpp/timeout.hpp"
+#include "asyncpp/futex.hpp"
+#include "asyncpp/event_count.hpp"
+#include "asyncpp/wait_strategy.hpp"
+
+namespace asyncpp
+{
+    //spinning locks for short critical sections, where parking in the
+    //kernel costs more than the section itself. each is Lockable and comes
+    //with a policy to plug it into the primitives, e.g.
+    //adv_queue<int, false, std::list<int>, ticket_policy>.
+
+    //spinning only pays off when the holder runs on another core
+    inline uint32_t spin_limit(uint32_t spins) {
+        static const bool single = std::thread::hardware_concurrency() <= 1;
+        return single ? 0 : spins;
+    }
+
+    //the condition variable the spin lock policies pair with
+    template<bool _InterProcess = false>
+    using futex_cond = event_cond<_InterProcess>;
+
+    //fair FIFO lock: threads take a ticket and wait for it to be served.
+    //waiters spin first and park on the serving word after _Spins rounds.
+    //with more threads than cores a handoff often goes to a parked thread,
+    //prefer adaptive_mutex there
+    template<bool _InterProcess = false, uint32_t _Spins = 1024>
+    class ticket_lock
+    {
+    public:
+        ticket_lock() = default;
+        ticket_lock(const ticket_lock &) = delete;
+        ticket_lock & operator = (const ticket_lock &) = delete;
+    public:
+        void lock() {
+            uint32_t ticket = mNext.fetch_add(1, std::memory_order_relaxed);
+            uint32_t serving = mServing.load(std::memory_order_acquire);
+            const uint32_t spins = spin_limit(_Spins);
+            for (uint32_t i = 0; serving != ticket; ++i) {
+                if (i < spins) {
+                    //back off in proportion to the place in line
+                    for (uint32_t k = ticket - serving; k > 0; --k) {
+                        cpu_relax();
+                    }
+                } else {
+                    mSleepers.fetch_add(1, std::memory_order_seq_cst);
+                    futex<_InterProcess>::wait(mServing, serving);
+                    mSleepers.fetch_sub(1, std::memory_order_relaxed);
+                }
+                serving = mServing.load(std::memory_order_acquire);
+            }
+        }
+        bool try_lock() {
+            uint32_t serving = mServing.load(std::memory_order_acquire);
+            uint32_t next = serving;
+            return mNext.compare_exchange_strong(next, serving + 1, std::memory_order_acquire);
+        }
+        void unlock() {
+            mServing.fetch_add(1, std::memory_order_seq_cst);
+            //only the next ticket may go, but the futex can't pick it
+            if (mSleepers.load(std::memory_order_seq_cst) != 0) {
+                futex<_InterProcess>::wake(mServing);
+            }
+        }
+    private:
+        alignas(64) std::atomic<uint32_t> mNext = 0;
+        alignas(64) std::atomic<uint32_t> mServing = 0;
+        std::atomic<uint32_t> mSleepers = 0;
+    };
+
+    //MCS queue lock: every waiter spins on a node of its own, so a release
+    //touches one waiter's cache line instead of all of them. nodes are
+    //thread local and so the lock can't be shared between processes.
+    template<uint32_t _Spins = 1024>
+    class mcs_lock
+    {
+    public:
+        mcs_lock() = default;
+        mcs_lock(const mcs_lock &) = delete;
+        mcs_lock & operator = (const mcs_lock &) = delete;
+    public:
+        void lock() {
+            node * n = _acquire_node();
+            n->next.store(nullptr, std::memory_order_relaxed);
+            n->state.store(WAITING, std::memory_order_relaxed);
+            node * prev = mTail.exchange(n, std::memory_order_acq_rel);
+            if (prev != nullptr) {
+                prev->next.store(n, std::memory_order_release);
+                _wait(n);
+            }
+            mOwner = n;
+        }
+        bool try_lock() {
+            node * n = _acquire_node();
+            n->next.store(nullptr, std::memory_order_relaxed);
+            node * expected = nullptr;
+            if (!mTail.compare_exchange_strong(expected, n, std::memory_order_acquire)) {
+                _release_node(n);
+                return false;
+            }
+            mOwner = n;
+            return true;
+        }
+        void unlock() {
+            node * n = mOwner;
+            node * next = n->next.load(std::memory_order_acquire);
+            if (next == nullptr) {
+                node * expected = n;
+                if (mTail.compare_exchange_strong(expected, nullptr, std::memory_order_release)) {
+                    _release_node(n);
+                    return;
+                }
+                //a successor swapped the tail but has not linked itself yet
+                while ((next = n->next.load(std::memory_order_acquire)) == nullptr) {
+                    cpu_relax();
+                }
+            }
+            if (next->state.exchange(GRANTED, std::memory_order_release) == SLEEPING) {
+                futex<>::wake(next->state, 1);
+            }
+            _release_node(n);
+        }
+    private:
+        enum : uint32_t {
+            WAITING = 0,
+            GRANTED = 1,
+            SLEEPING = 2,
+        };
+
+        struct alignas(64) node
+        {
+            std::atomic<node *> next = nullptr;
+            std::atomic<uint32_t> state = WAITING;
+            node * free = nullptr;
+        };
+
+        //a thread may hold several locks at once, it keeps a free list of
+        //nodes. a node is no longer referenced once unlock() returns
+        struct node_cache
+        {
+            node * free = nullptr;
+            ~node_cache() {
+                while (free != nullptr) {
+                    node * n = free;
+                    free = n->free;
+                    delete n;
+                }
+            }
+        };
+        static node_cache & _cache() {
+            static thread_local node_cache cache;
+            return cache;
+        }
+        static node * _acquire_node() {
+            node_cache & cache = _cache();
+            if (cache.free == nullptr) {
+                return new node();
+            }
+            node * n = cache.free;
+            cache.free = n->free;
+            return n;
+        }
+        static void _release_node(node * n) {
+            node_cache & cache = _cache();
+            n->free = cache.free;
+            cache.free = n;
+        }
+
+        static void _wait(node * n) {
+            for (uint32_t i = 0, spins = spin_limit(_Spins); i < spins; ++i) {
+                if (n->state.load(std::memory_order_acquire) == GRANTED) {
+                    return;
+                }
+                cpu_relax();
+            }
+            uint32_t state = WAITING;
+            if (n->state.compare_exchange_strong(state, SLEEPING, std::memory_order_acquire)) {
+                while (n->state.load(std::memory_order_acquire) != GRANTED) {
+                    futex<>::wait(n->state, SLEEPING);
+                }
+            }
+        }
+    private:
+        alignas(64) std::atomic<node *> mTail = nullptr;
+        //written by the holder only
+        node * mOwner = nullptr;
+    };
+
+    //spins on the lock word for a while, then parks on it.
+    //the word is 0 unlocked, 1 locked, 2 locked with sleepers
+    template<bool _InterProcess = false, uint32_t _Spins = 256>
+    class adaptive_mutex
+    {
+    public:
+        adaptive_mutex() = default;
+        adaptive_mutex(const adaptive_mutex &) = delete;
+        adaptive_mutex & operator = (const adaptive_mutex &) = delete;
+    public:
+        void lock() {
+            uint32_t state = UNLOCKED;
+            if (mState.compare_exchange_strong(state, LOCKED, std::memory_order_acquire)) {
+                return;
+            }
+            for (uint32_t i = 0, spins = spin_limit(_Spins); i < spins; ++i) {
+                cpu_relax();
+                state = mState.load(std::memory_order_relaxed);
+                if (state == UNLOCKED
+                        && mState.compare_exchange_weak(state, LOCKED, std::memory_order_acquire)) {
+                    return;
+                }
+            }
+            //from here on the lock is taken as contended, so unlock wakes
+            while (mState.exchange(CONTENDED, std::memory_order_acquire) != UNLOCKED) {
+                futex<_InterProcess>::wait(mState, CONTENDED);
+            }
+        }
+        bool try_lock() {
+            uint32_t state = UNLOCKED;
+            return mState.compare_exchange_strong(state, LOCKED, std::memory_order_acquire);
+        }
+        void unlock() {
+            if (mState.exchange(UNLOCKED, std::memory_order_release) == CONTENDED) {
+                futex<_InterProcess>::wake(mState, 1);
+            }
+        }
+    private:
+        enum : uint32_t {
+            UNLOCKED = 0,
+            LOCKED = 1,
+            CONTENDED = 2,
+        };
+        std::atomic<uint32_t> mState = UNLOCKED;
+    };
+
+    template<bool _InterProcess = false>
+    struct ticket_policy
+    {
+        using mutex_t = ticket_lock<_InterProcess>;
+        using cond_t = futex_cond<_InterProcess>;
+        using lock_t = std::unique_lock<mutex_t>;
+    };
+
+    template<bool _InterProcess = false>
+    struct mcs_policy
+    {
+        static_assert(!_InterProcess, "mcs_lock can't be shared between processes");
+        using mutex_t = mcs_lock<>;
+        using cond_t = futex_cond<false>;
+        using lock_t = std::unique_lock<mutex_t>;
+    };
+
+    template<bool _InterProcess = false>
+    struct adaptive_policy
+    {
+        using mutex_t = adaptive_mutex<_InterProcess>;
+        using cond_t = futex_cond<_InterProcess>;
+        using lock_t = std::unique_lock<mutex_t>;
+    };
+}
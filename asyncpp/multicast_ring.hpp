@@ -0,0 +1,276 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <array>
+#include <atomic>
+#include <initializer_list>
+
+#include "asyncpp/common.hpp"
+#include "asyncpp/timeout.hpp"
+#include "asyncpp/wait_strategy.hpp"
+
+namespace asyncpp
+{
+    //one publisher writes every item once, each consumer walks the ring with
+    //its own sequence. a consumer may depend on other consumers and then never
+    //passes them. the publisher is gated by the slowest consumer.
+    //each consumer id must be served by a single thread, and so must publishing.
+    template<
+        typename _Item,
+        std::size_t _Cap,
+        std::size_t _MaxConsumers = 8,
+        typename _Wait = phased_wait<>>
+    class multicast_ring
+    {
+        static_assert(_Cap > 0 && (_Cap & (_Cap - 1)) == 0, "capacity must be a power of two");
+        static_assert(_MaxConsumers > 0 && _MaxConsumers <= 64, "at most 64 consumers");
+    public:
+        multicast_ring() = default;
+        multicast_ring(const multicast_ring &) = delete;
+        multicast_ring & operator = (const multicast_ring &) = delete;
+    public:
+        using sequence_t = int64_t;
+    public:
+        //manipulating functions:
+        //consumers are added before enable(), deps must already exist
+        result_code add_consumer(std::size_t & id, std::initializer_list<std::size_t> deps = {}) {
+            if (mEnabled.load(std::memory_order_acquire)) {
+                return result_code::INCORRECT_STATE;
+            }
+            if (mConsumerCount == _MaxConsumers) {
+                return result_code::UNAVAILABLE_OR_TIMEOUT;
+            }
+            uint64_t mask = 0;
+            for (std::size_t dep : deps) {
+                if (dep >= mConsumerCount) {
+                    return result_code::INVALID_ARGUMENTS;
+                }
+                mask |= (uint64_t)1 << dep;
+            }
+            id = mConsumerCount++;
+            mConsumers[id].deps = mask;
+            return result_code::SUCCEED;
+        }
+
+        result_code enable() {
+            if (mConsumerCount == 0) {
+                return result_code::INCORRECT_STATE;
+            }
+            mCursor.value.store(-1, std::memory_order_relaxed);
+            mGate = -1;
+            for (std::size_t i = 0; i < mConsumerCount; ++i) {
+                mConsumers[i].seq.store(-1, std::memory_order_relaxed);
+                mConsumers[i].available = -1;
+            }
+            mEnabled.store(true, std::memory_order_release);
+            return result_code::SUCCEED;
+        }
+
+        void disable() {
+            mEnabled.store(false, std::memory_order_release);
+            mPubWait.notify();
+            mConsWait.notify();
+        }
+
+        //waits until every consumer has seen everything published so far
+        result_code drain(const timeout & to = timeout()) {
+            if (!_enabled()) {
+                return result_code::DISABLED;
+            }
+            sequence_t cursor = mCursor.value.load(std::memory_order_acquire);
+            result_code res = mPubWait.wait([&] {
+                return !_enabled() || _min_sequence() >= cursor;
+            }, to);
+            if (res != result_code::SUCCEED) {
+                return res;
+            }
+            return _enabled() ? result_code::SUCCEED : result_code::DISABLED;
+        }
+
+        std::size_t get_consumer_count() const {
+            return mConsumerCount;
+        }
+
+        sequence_t get_cursor() const {
+            return mCursor.value.load(std::memory_order_acquire);
+        }
+
+        sequence_t get_sequence(std::size_t id) const {
+            return mConsumers[id].seq.load(std::memory_order_acquire);
+        }
+
+        //data functions
+        result_code publish(const _Item & item, const timeout & to = timeout()) {
+            return _publish([&](_Item & slot) { slot = item; }, to);
+        }
+        result_code publish(_Item && item, const timeout & to = timeout()) {
+            return _publish([&](_Item & slot) { slot = std::move(item); }, to);
+        }
+        result_code try_publish(const _Item & item) {
+            return _try_publish([&](_Item & slot) { slot = item; });
+        }
+        result_code try_publish(_Item && item) {
+            return _try_publish([&](_Item & slot) { slot = std::move(item); });
+        }
+
+        result_code consume(std::size_t id, _Item & item, const timeout & to = timeout()) {
+            return consume_batch(id, [&](const _Item & slot) { item = slot; }, 1, to);
+        }
+        result_code try_consume(std::size_t id, _Item & item) {
+            if (id >= mConsumerCount) {
+                return result_code::INVALID_ARGUMENTS;
+            }
+            if (!_enabled()) {
+                return result_code::DISABLED;
+            }
+            consumer & c = mConsumers[id];
+            sequence_t next = c.seq.load(std::memory_order_relaxed) + 1;
+            if (!_available(c, next)) {
+                return result_code::UNAVAILABLE_OR_TIMEOUT;
+            }
+            item = mSlots[next & (_Cap - 1)];
+            _advance(c, next);
+            return result_code::SUCCEED;
+        }
+
+        //hands up to max items to proc in place, proc(const _Item &)
+        template<typename _Proc>
+        result_code consume_batch(
+                std::size_t id,
+                const _Proc & proc,
+                std::size_t max = SIZE_MAX,
+                const timeout & to = timeout()) {
+            if (id >= mConsumerCount || max == 0) {
+                return result_code::INVALID_ARGUMENTS;
+            }
+            if (!_enabled()) {
+                return result_code::DISABLED;
+            }
+            consumer & c = mConsumers[id];
+            sequence_t next = c.seq.load(std::memory_order_relaxed) + 1;
+            result_code res = mConsWait.wait([&] {
+                return !_enabled() || _available(c, next);
+            }, to);
+            if (res != result_code::SUCCEED) {
+                return res;
+            }
+            if (!_enabled()) {
+                return result_code::DISABLED;
+            }
+            sequence_t last = c.available;
+            if ((std::size_t)(last - next) >= max) {
+                last = next + (sequence_t)max - 1;
+            }
+            for (sequence_t s = next; s <= last; ++s) {
+                proc(mSlots[s & (_Cap - 1)]);
+            }
+            _advance(c, last);
+            return result_code::SUCCEED;
+        }
+
+    private:
+        struct alignas(64) consumer
+        {
+            std::atomic<sequence_t> seq = -1;
+            //touched by the owning consumer thread only
+            sequence_t available = -1;
+            uint64_t deps = 0;
+        };
+        struct alignas(64) padded_sequence
+        {
+            std::atomic<sequence_t> value = -1;
+        };
+
+        inline bool _enabled() const {
+            return mEnabled.load(std::memory_order_acquire);
+        }
+
+        sequence_t _min_sequence() const {
+            sequence_t min = mCursor.value.load(std::memory_order_relaxed);
+            for (std::size_t i = 0; i < mConsumerCount; ++i) {
+                sequence_t s = mConsumers[i].seq.load(std::memory_order_acquire);
+                if (s < min) {
+                    min = s;
+                }
+            }
+            return min;
+        }
+
+        //refreshes the cached upper bound of what consumer c may read
+        bool _available(consumer & c, sequence_t next) {
+            if (c.available >= next) {
+                return true;
+            }
+            sequence_t avail = mCursor.value.load(std::memory_order_acquire);
+            for (uint64_t deps = c.deps; deps != 0; deps &= deps - 1) {
+                sequence_t s = mConsumers[__builtin_ctzll(deps)].seq.load(std::memory_order_acquire);
+                if (s < avail) {
+                    avail = s;
+                }
+            }
+            c.available = avail;
+            return avail >= next;
+        }
+
+        void _advance(consumer & c, sequence_t last) {
+            c.seq.store(last, std::memory_order_release);
+            mPubWait.notify();
+            mConsWait.notify();
+        }
+
+        bool _has_room(sequence_t next) {
+            if (next - (sequence_t)_Cap <= mGate) {
+                return true;
+            }
+            mGate = _min_sequence();
+            return next - (sequence_t)_Cap <= mGate;
+        }
+
+        template<typename _Assign>
+        result_code _publish(const _Assign & assign, const timeout & to) {
+            if (!_enabled()) {
+                return result_code::DISABLED;
+            }
+            sequence_t next = mCursor.value.load(std::memory_order_relaxed) + 1;
+            result_code res = mPubWait.wait([&] {
+                return !_enabled() || _has_room(next);
+            }, to);
+            if (res != result_code::SUCCEED) {
+                return res;
+            }
+            if (!_enabled()) {
+                return result_code::DISABLED;
+            }
+            assign(mSlots[next & (_Cap - 1)]);
+            mCursor.value.store(next, std::memory_order_release);
+            mConsWait.notify();
+            return result_code::SUCCEED;
+        }
+
+        template<typename _Assign>
+        result_code _try_publish(const _Assign & assign) {
+            if (!_enabled()) {
+                return result_code::DISABLED;
+            }
+            sequence_t next = mCursor.value.load(std::memory_order_relaxed) + 1;
+            if (!_has_room(next)) {
+                return result_code::UNAVAILABLE_OR_TIMEOUT;
+            }
+            assign(mSlots[next & (_Cap - 1)]);
+            mCursor.value.store(next, std::memory_order_release);
+            mConsWait.notify();
+            return result_code::SUCCEED;
+        }
+    private:
+        padded_sequence mCursor;
+        //publisher side cache of the slowest consumer
+        sequence_t mGate = -1;
+        std::atomic<bool> mEnabled = false;
+        std::size_t mConsumerCount = 0;
+        std::array<consumer, _MaxConsumers> mConsumers;
+        _Wait mPubWait;
+        _Wait mConsWait;
+        std::array<_Item, _Cap> mSlots;
+    };
+}
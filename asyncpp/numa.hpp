@@ -0,0 +1,318 @@
+#pragma once
+
+#include <linux/mempolicy.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sched.h>
+#include <unistd.h>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include "asyncpp/common.hpp"
+#include "asyncpp/timeout.hpp"
+#include "asyncpp/event_count.hpp"
+
+namespace asyncpp
+{
+    //NUMA placement through the raw system calls, no libnuma needed.
+    //on single node machines, or kernels without NUMA support, everything
+    //reports one node and placing memory is a no-op that succeeds.
+    struct numa
+    {
+        static constexpr int max_nodes = 1024;
+
+        //nodes online, at least 1
+        static int node_count() {
+            static const int count = [] {
+                std::vector<int> nodes;
+                _parse_list("/sys/devices/system/node/online", nodes);
+                int highest = 0;
+                for (int n : nodes) {
+                    highest = n > highest ? n : highest;
+                }
+                return highest + 1;
+            }();
+            return count;
+        }
+
+        //the node of the cpu the caller runs on right now
+        static int current_node() {
+            unsigned cpu = 0;
+            unsigned node = 0;
+            if (syscall(SYS_getcpu, &cpu, &node, nullptr) != 0) {
+                return 0;
+            }
+            return (int)node;
+        }
+
+        //the node backing the page at addr, -1 when unknown or not faulted in
+        static int node_of(const void * addr) {
+            int node = -1;
+            if (syscall(SYS_get_mempolicy, &node, nullptr, 0ul, addr, (unsigned long)(MPOL_F_NODE | MPOL_F_ADDR)) != 0) {
+                return -1;
+            }
+            return node;
+        }
+
+        //binds the pages overlapping [addr, addr + len) to node and moves
+        //those already faulted in. pages are shared with whatever else
+        //lives on them, see numa_placed for storage of its own
+        static result_code bind(void * addr, std::size_t len, int node) {
+            if (addr == nullptr || len == 0 || node < 0 || node >= max_nodes) {
+                return result_code::INVALID_ARGUMENTS;
+            }
+            if (node_count() == 1 && node == 0) {
+                return result_code::SUCCEED;
+            }
+            uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+            uintptr_t begin = (uintptr_t)addr / page * page;
+            uintptr_t end = ((uintptr_t)addr + len + page - 1) / page * page;
+            unsigned long mask[max_nodes / (8 * sizeof(unsigned long))] = {};
+            mask[node / (8 * sizeof(unsigned long))] = 1ul << (node % (8 * sizeof(unsigned long)));
+            long res = syscall(SYS_mbind, (void *)begin, end - begin, MPOL_BIND,
+                mask, (unsigned long)max_nodes, MPOL_MF_MOVE);
+            return res == 0 ? result_code::SUCCEED : result_code::UNAVAILABLE_OR_TIMEOUT;
+        }
+        template<typename _T>
+        static result_code bind_object(_T & obj, int node) {
+            return bind(&obj, sizeof(_T), node);
+        }
+        //to the caller's node, e.g. called by the consumer of a queue
+        template<typename _T>
+        static result_code bind_here(_T & obj) {
+            return bind(&obj, sizeof(_T), current_node());
+        }
+
+        //new pages of the calling thread come from node while it has room,
+        //so storage the thread then allocates and touches is local to it.
+        //-1 drops back to the default policy
+        static result_code prefer_node(int node) {
+            if (node >= max_nodes) {
+                return result_code::INVALID_ARGUMENTS;
+            }
+            if (node_count() == 1 && node <= 0) {
+                return result_code::SUCCEED;
+            }
+            long res = 0;
+            if (node < 0) {
+                res = syscall(SYS_set_mempolicy, MPOL_DEFAULT, nullptr, 0ul);
+            } else {
+                unsigned long mask[max_nodes / (8 * sizeof(unsigned long))] = {};
+                mask[node / (8 * sizeof(unsigned long))] = 1ul << (node % (8 * sizeof(unsigned long)));
+                res = syscall(SYS_set_mempolicy, MPOL_PREFERRED, mask, (unsigned long)max_nodes);
+            }
+            return res == 0 ? result_code::SUCCEED : result_code::UNAVAILABLE_OR_TIMEOUT;
+        }
+
+        //keeps the calling thread on the cpus of node
+        static result_code run_on_node(int node) {
+            char path[64];
+            std::snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+            std::vector<int> cpus;
+            if (!_parse_list(path, cpus)) {
+                return node == 0 ? result_code::SUCCEED : result_code::INVALID_ARGUMENTS;
+            }
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            for (int cpu : cpus) {
+                CPU_SET(cpu, &set);
+            }
+            return sched_setaffinity(0, sizeof(set), &set) == 0
+                ? result_code::SUCCEED
+                : result_code::UNAVAILABLE_OR_TIMEOUT;
+        }
+
+        //reads lists like "0-3,8-11", false when the file is missing
+        static bool _parse_list(const char * path, std::vector<int> & values) {
+            FILE * f = std::fopen(path, "r");
+            if (f == nullptr) {
+                return false;
+            }
+            int first = 0;
+            int last = 0;
+            char sep = 0;
+            while (std::fscanf(f, "%d", &first) == 1) {
+                last = first;
+                if (std::fscanf(f, "%c", &sep) == 1 && sep == '-') {
+                    if (std::fscanf(f, "%d", &last) != 1) {
+                        break;
+                    }
+                    std::fscanf(f, "%c", &sep);
+                }
+                for (int v = first; v <= last; ++v) {
+                    values.push_back(v);
+                }
+            }
+            std::fclose(f);
+            return !values.empty();
+        }
+    };
+
+    //a _T on pages of its own bound to one node, so it shares neither
+    //pages with its neighbours nor their first-touch placement.
+    //meant for inline storage, e.g. a queue on flat_ring_queue
+    template<typename _T>
+    class numa_placed
+    {
+    public:
+        numa_placed() = default;
+        numa_placed(const numa_placed &) = delete;
+        numa_placed & operator = (const numa_placed &) = delete;
+        ~numa_placed() {
+            destroy();
+        }
+    public:
+        //a node that is not bound to still gets the object, placed as
+        //the kernel likes: the result tells
+        template<typename ..._Args>
+        result_code create(int node, _Args && ...args) {
+            if (mObject != nullptr) {
+                return result_code::INCORRECT_STATE;
+            }
+            std::size_t page = (std::size_t)sysconf(_SC_PAGESIZE);
+            mSize = (sizeof(_T) + page - 1) / page * page;
+            void * mem = mmap(nullptr, mSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (mem == MAP_FAILED) {
+                return result_code::UNAVAILABLE_OR_TIMEOUT;
+            }
+            //bound before the constructor touches the pages
+            result_code res = numa::bind(mem, mSize, node);
+            mObject = new (mem) _T(std::forward<_Args>(args)...);
+            mNode = node;
+            return res;
+        }
+        void destroy() {
+            if (mObject != nullptr) {
+                mObject->~_T();
+                munmap(mObject, mSize);
+                mObject = nullptr;
+            }
+        }
+        //moves the pages, e.g. to the consumer once it is known
+        result_code move_to(int node) {
+            if (mObject == nullptr) {
+                return result_code::INCORRECT_STATE;
+            }
+            result_code res = numa::bind(mObject, mSize, node);
+            if (res == result_code::SUCCEED) {
+                mNode = node;
+            }
+            return res;
+        }
+
+        _T * get() const {
+            return mObject;
+        }
+        _T & operator * () const {
+            return *mObject;
+        }
+        _T * operator -> () const {
+            return mObject;
+        }
+        int get_node() const {
+            return mNode;
+        }
+    private:
+        _T * mObject = nullptr;
+        std::size_t mSize = 0;
+        int mNode = 0;
+    };
+
+    //one shard of _Queue per node for many producers spread over nodes.
+    //a push goes to the shard on the pusher's node, so producers only
+    //write local memory; a pop takes from its own node's shard first and
+    //then from the others. items keep their order within a shard only.
+    //_Queue is an adv_queue or basic_queue flavour, in-process
+    template<typename _Queue, typename _Item>
+    class numa_sharded
+    {
+    public:
+        numa_sharded() = default;
+        numa_sharded(const numa_sharded &) = delete;
+        numa_sharded & operator = (const numa_sharded &) = delete;
+    public:
+        //capacity per shard
+        result_code enable(uint32_t capacity, int nodes = numa::node_count()) {
+            if (capacity == 0 || nodes <= 0) {
+                return result_code::INVALID_ARGUMENTS;
+            }
+            if (!mShards.empty()) {
+                return result_code::INCORRECT_STATE;
+            }
+            mShards = std::vector<numa_placed<_Queue>>(nodes);
+            for (int n = 0; n < nodes; ++n) {
+                //binding is best effort, the shard works anywhere
+                mShards[n].create(n);
+                mShards[n]->enable(capacity);
+            }
+            mEnabled.store(true, std::memory_order_release);
+            return result_code::SUCCEED;
+        }
+        void disable() {
+            mEnabled.store(false, std::memory_order_release);
+            for (auto & s : mShards) {
+                s->disable();
+            }
+            mEvents.notify_all();
+        }
+
+        uint32_t get_shard_count() const {
+            return (uint32_t)mShards.size();
+        }
+        _Queue & get_shard(int node) {
+            return *mShards[node];
+        }
+
+        template<typename _Ref>
+        result_code push(_Ref && item, const timeout & to = timeout()) {
+            if (!mEnabled.load(std::memory_order_acquire)) {
+                return result_code::DISABLED;
+            }
+            result_code res = _home()->push(std::forward<_Ref>(item), to);
+            if (res == result_code::SUCCEED) {
+                mEvents.notify_one();
+            }
+            return res;
+        }
+
+        result_code pop(_Item & item, const timeout & to = timeout()) {
+            result_code res = result_code::UNAVAILABLE_OR_TIMEOUT;
+            result_code waited = mEvents.wait([&] {
+                res = try_pop(item);
+                return res != result_code::UNAVAILABLE_OR_TIMEOUT;
+            }, to);
+            return waited == result_code::SUCCEED ? res : waited;
+        }
+        result_code try_pop(_Item & item) {
+            if (!mEnabled.load(std::memory_order_acquire)) {
+                return result_code::DISABLED;
+            }
+            int count = (int)mShards.size();
+            int home = _node();
+            for (int i = 0; i < count; ++i) {
+                result_code res = mShards[(home + i) % count]->try_pop(item);
+                if (res == result_code::SUCCEED) {
+                    return res;
+                }
+            }
+            return result_code::UNAVAILABLE_OR_TIMEOUT;
+        }
+    private:
+        int _node() const {
+            int node = numa::current_node();
+            return node < (int)mShards.size() ? node : node % (int)mShards.size();
+        }
+        _Queue * _home() {
+            return mShards[_node()].get();
+        }
+    private:
+        std::vector<numa_placed<_Queue>> mShards;
+        std::atomic<bool> mEnabled = false;
+        event_count<false> mEvents;
+    };
+}
@@ -0,0 +1,350 @@
+#pragma once
+
+#include <atomic>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+#include "asyncpp/common.hpp"
+
+namespace asyncpp
+{
+    //a fixed set of _Cap objects handed out and taken back, so payloads
+    //moving between threads are recycled instead of freed on another
+    //thread. objects are default constructed once with the pool and keep
+    //their state, e.g. a vector's capacity: reset what you need to.
+    //
+    //every thread works on one of _Caches caches picked by its thread
+    //number, an object remembers the cache that handed it out as its home.
+    //a release on the home cache goes back to it, a release elsewhere is
+    //collected and sent home in batches, on a list the home takes at once.
+    //caches fill up from, and spill to, a shared lock-free free list whose
+    //head carries a tag against ABA. a cache busy with another thread is
+    //bypassed, never waited for.
+    //
+    //links are indices, so a pool placed in shared memory works across
+    //processes (_InterProcess): pass indices through a queue there, since a
+    //handle points at the pool in its own address space. objects released
+    //elsewhere but not yet sent home are only reached after flush() of the
+    //thread holding them, at most _CacheSize / 2 per cache.
+    template<
+        typename _T,
+        uint32_t _Cap,
+        bool _InterProcess = false,
+        uint32_t _Caches = 16,
+        uint32_t _CacheSize = 32>
+    class object_pool
+    {
+        static_assert(_Cap > 0 && _Cap < UINT32_MAX, "unreasonable capacity");
+        static_assert(_Caches > 0 && _Caches <= 0xffff, "unreasonable cache count");
+        static_assert(_CacheSize >= 2, "caches hold at least two objects");
+        static_assert(std::is_default_constructible<_T>::value, "objects are built with the pool");
+        static_assert(std::atomic<uint64_t>::is_always_lock_free, "lock free atomics required");
+        static_assert(!_InterProcess || std::is_trivially_copyable<_T>::value,
+            "objects shared between processes can't own process local memory");
+    public:
+        object_pool() {
+            for (uint32_t i = 0; i < _Cap; ++i) {
+                mSlots[i].next.store(i + 1 < _Cap ? i + 2 : 0, std::memory_order_relaxed);
+            }
+            mFree.store(1, std::memory_order_release);
+        }
+        object_pool(const object_pool &) = delete;
+        object_pool & operator = (const object_pool &) = delete;
+    public:
+        //owns one object and gives it back on destruction, moves through
+        //queues like any other item. process local, see above
+        class handle
+        {
+        public:
+            handle() = default;
+            handle(object_pool * pool, uint32_t index) : mPool(pool), mIndex(index) {}
+            handle(const handle &) = delete;
+            handle & operator = (const handle &) = delete;
+            handle(handle && other) : mPool(other.mPool), mIndex(other.mIndex) {
+                other.mPool = nullptr;
+            }
+            handle & operator = (handle && other) {
+                if (this != &other) {
+                    reset();
+                    mPool = other.mPool;
+                    mIndex = other.mIndex;
+                    other.mPool = nullptr;
+                }
+                return *this;
+            }
+            ~handle() {
+                reset();
+            }
+        public:
+            void reset() {
+                if (mPool != nullptr) {
+                    mPool->release(mIndex);
+                    mPool = nullptr;
+                }
+            }
+            //gives the object up without releasing it, e.g. to pass it
+            //to another process
+            uint32_t detach() {
+                mPool = nullptr;
+                return mIndex;
+            }
+            uint32_t get_index() const {
+                return mIndex;
+            }
+            _T * get() const {
+                return mPool != nullptr ? &mPool->get(mIndex) : nullptr;
+            }
+            _T & operator * () const {
+                return mPool->get(mIndex);
+            }
+            _T * operator -> () const {
+                return &mPool->get(mIndex);
+            }
+            explicit operator bool() const {
+                return mPool != nullptr;
+            }
+        private:
+            object_pool * mPool = nullptr;
+            uint32_t mIndex = 0;
+        };
+    public:
+        result_code acquire(handle & h) {
+            uint32_t index = 0;
+            result_code res = acquire(index);
+            if (res == result_code::SUCCEED) {
+                h = handle(this, index);
+            }
+            return res;
+        }
+        //UNAVAILABLE_OR_TIMEOUT when every object is out
+        result_code acquire(uint32_t & index) {
+            uint32_t c = _thread_cache();
+            cache & own = mCaches[c];
+            if (!own.busy.exchange(true, std::memory_order_acquire)) {
+                uint32_t n = _refill(own);
+                if (n != 0) {
+                    index = n - 1;
+                    mSlots[index].home = (uint16_t)c;
+                }
+                own.busy.store(false, std::memory_order_release);
+                if (n != 0) {
+                    return result_code::SUCCEED;
+                }
+            } else {
+                uint32_t n = _pop_free(1);
+                if (n != 0) {
+                    index = n - 1;
+                    mSlots[index].home = (uint16_t)c;
+                    return result_code::SUCCEED;
+                }
+            }
+            //the last resort: whatever was sent home to any cache
+            for (uint32_t k = 0; k < _Caches; ++k) {
+                uint32_t n = mCaches[k].returned.exchange(0, std::memory_order_acquire);
+                if (n != 0) {
+                    index = n - 1;
+                    mSlots[index].home = (uint16_t)c;
+                    uint32_t rest = _next(index);
+                    if (rest != 0) {
+                        _push_free(rest, _tail(rest));
+                    }
+                    return result_code::SUCCEED;
+                }
+            }
+            return result_code::UNAVAILABLE_OR_TIMEOUT;
+        }
+
+        result_code release(uint32_t index) {
+            if (index >= _Cap) {
+                return result_code::INVALID_ARGUMENTS;
+            }
+            uint32_t c = _thread_cache();
+            cache & own = mCaches[c];
+            uint32_t home = mSlots[index].home;
+            if (own.busy.exchange(true, std::memory_order_acquire)) {
+                _push_returned(mCaches[home], index + 1, index + 1);
+                return result_code::SUCCEED;
+            }
+            if (home == c) {
+                if (own.count == _CacheSize) {
+                    _spill(own, _CacheSize / 2);
+                }
+                own.items[own.count++] = index;
+            } else {
+                if (own.batchCount > 0 && own.batchHome != home) {
+                    _send_batch(own);
+                }
+                //chained through the objects, the head is the newest
+                _link(index, own.batchCount > 0 ? own.batchHead : 0);
+                if (own.batchCount++ == 0) {
+                    own.batchTail = index + 1;
+                    own.batchHome = home;
+                }
+                own.batchHead = index + 1;
+                if (own.batchCount >= _CacheSize / 2) {
+                    _send_batch(own);
+                }
+            }
+            own.busy.store(false, std::memory_order_release);
+            return result_code::SUCCEED;
+        }
+
+        //sends the calling thread's pending batch home and its cached
+        //objects to the shared list, e.g. before the thread goes away
+        void flush() {
+            cache & own = mCaches[_thread_cache()];
+            while (own.busy.exchange(true, std::memory_order_acquire)) {
+            }
+            if (own.batchCount > 0) {
+                _send_batch(own);
+            }
+            _spill(own, own.count);
+            own.busy.store(false, std::memory_order_release);
+        }
+
+        _T & get(uint32_t index) {
+            return mSlots[index].object;
+        }
+        static constexpr uint32_t get_capacity() {
+            return _Cap;
+        }
+    private:
+        struct slot
+        {
+            _T object;
+            //1 based index of the next object on a list, 0 ends it
+            std::atomic<uint32_t> next = 0;
+            uint16_t home = 0;
+        };
+
+        struct alignas(64) cache
+        {
+            std::atomic<bool> busy = false;
+            uint32_t count = 0;
+            uint32_t items[_CacheSize];
+            //objects sent home by other caches, taken all at once
+            std::atomic<uint32_t> returned = 0;
+            //objects released here for another home, 1 based
+            uint32_t batchHead = 0;
+            uint32_t batchTail = 0;
+            uint32_t batchCount = 0;
+            uint32_t batchHome = 0;
+        };
+
+        //the pool's cache for the calling thread, threads are numbered in
+        //the order they first ask
+        static uint32_t _thread_cache() {
+            static std::atomic<uint32_t> threads = 0;
+            thread_local uint32_t number = threads.fetch_add(1, std::memory_order_relaxed);
+            return number % _Caches;
+        }
+
+        inline uint32_t _next(uint32_t index) const {
+            return mSlots[index].next.load(std::memory_order_relaxed);
+        }
+        inline void _link(uint32_t index, uint32_t next) {
+            mSlots[index].next.store(next, std::memory_order_relaxed);
+        }
+        uint32_t _tail(uint32_t n) const {
+            while (_next(n - 1) != 0) {
+                n = _next(n - 1);
+            }
+            return n;
+        }
+
+        //the shared list: 1 based head index in the low half, a tag bumped
+        //by every change in the high half
+        void _push_free(uint32_t head, uint32_t tail) {
+            uint64_t old = mFree.load(std::memory_order_relaxed);
+            uint64_t desired = 0;
+            do {
+                _link(tail - 1, (uint32_t)old);
+                desired = ((old >> 32) + 1) << 32 | head;
+            } while (!mFree.compare_exchange_weak(old, desired,
+                std::memory_order_release, std::memory_order_relaxed));
+        }
+        //takes a chain of up to count objects, 1 based head or 0. the links
+        //read may be stale, the tag then fails the exchange
+        uint32_t _pop_free(uint32_t count) {
+            uint64_t old = mFree.load(std::memory_order_acquire);
+            while (true) {
+                uint32_t head = (uint32_t)old;
+                if (head == 0) {
+                    return 0;
+                }
+                uint32_t last = head;
+                uint32_t rest = _next(last - 1);
+                for (uint32_t i = 1; i < count && rest != 0 && rest <= _Cap; ++i) {
+                    last = rest;
+                    rest = _next(last - 1);
+                }
+                uint64_t desired = ((old >> 32) + 1) << 32 | (rest <= _Cap ? rest : 0);
+                if (mFree.compare_exchange_weak(old, desired,
+                        std::memory_order_acquire, std::memory_order_acquire)) {
+                    _link(last - 1, 0);
+                    return head;
+                }
+            }
+        }
+
+        //pushing while the owner takes everything is safe without a tag
+        void _push_returned(cache & home, uint32_t head, uint32_t tail) {
+            uint32_t old = home.returned.load(std::memory_order_relaxed);
+            do {
+                _link(tail - 1, old);
+            } while (!home.returned.compare_exchange_weak(old, head,
+                std::memory_order_release, std::memory_order_relaxed));
+        }
+
+        void _send_batch(cache & own) {
+            _push_returned(mCaches[own.batchHome], own.batchHead, own.batchTail);
+            own.batchCount = 0;
+            own.batchHead = 0;
+        }
+
+        //moves the count oldest cached objects to the shared list
+        void _spill(cache & own, uint32_t count) {
+            if (count == 0) {
+                return;
+            }
+            for (uint32_t i = 0; i < count; ++i) {
+                _link(own.items[i], i + 1 < count ? own.items[i + 1] + 1 : 0);
+            }
+            _push_free(own.items[0] + 1, own.items[count - 1] + 1);
+            for (uint32_t i = count; i < own.count; ++i) {
+                own.items[i - count] = own.items[i];
+            }
+            own.count -= count;
+        }
+
+        //an object for the owner of own, 1 based or 0: cached ones first,
+        //then those sent home, then a batch from the shared list
+        uint32_t _refill(cache & own) {
+            if (own.count == 0) {
+                uint32_t n = own.returned.exchange(0, std::memory_order_acquire);
+                if (n == 0) {
+                    n = _pop_free(_CacheSize / 2);
+                }
+                while (n != 0) {
+                    uint32_t next = _next(n - 1);
+                    if (own.count == _CacheSize) {
+                        _push_free(n, _tail(n));
+                        break;
+                    }
+                    own.items[own.count++] = n - 1;
+                    n = next;
+                }
+            }
+            if (own.count == 0) {
+                return 0;
+            }
+            return own.items[--own.count] + 1;
+        }
+    private:
+        std::array<slot, _Cap> mSlots;
+        std::array<cache, _Caches> mCaches;
+        alignas(64) std::atomic<uint64_t> mFree = 0;
+    };
+}
@@ -0,0 +1,321 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "asyncpp/common.hpp"
+#include "asyncpp/pthread_wrapper.hpp"
+#include "asyncpp/wait_strategy.hpp"
+
+namespace asyncpp
+{
+    //keeps a value on a cache line of its own
+    template<typename _T>
+    struct alignas(64) cache_padded
+    {
+        _T value;
+    };
+
+    //a persistent set of worker threads for fork-join loops.
+    //every thread taking part owns a deque of range tasks: it pops its own
+    //from the back and steals from the others' front, where the largest
+    //ranges are. a range is split in halves only while the owner's deque is
+    //empty (lazy binary splitting), so the grain adapts to how hungry the
+    //other threads are. the calling thread works on the loop too.
+    //also an executor, see future.hpp.
+    class worker_pool
+    {
+    public:
+        using mutex_t = typename sync_policy<false>::mutex_t;
+        using lock_t = typename sync_policy<false>::lock_t;
+    public:
+        //the caller takes part in every loop, so one core is left for it
+        static uint32_t default_workers() {
+            uint32_t n = std::thread::hardware_concurrency();
+            return n > 1 ? n - 1 : 1;
+        }
+
+        explicit worker_pool(uint32_t workers = default_workers()) {
+            if (workers == 0) {
+                workers = 1;
+            }
+            //slot 0 is for threads outside the pool
+            mSlotCount = workers + 1;
+            mSlots.reset(new slot[mSlotCount]);
+            for (uint32_t i = 1; i <= workers; ++i) {
+                mThreads.emplace_back([this, i]() {
+                    _work(i);
+                });
+            }
+        }
+        worker_pool(const worker_pool &) = delete;
+        worker_pool & operator = (const worker_pool &) = delete;
+        //runs whatever was queued before the workers leave
+        ~worker_pool() {
+            mStopping.store(true, std::memory_order_release);
+            mWait.notify();
+            for (auto & t : mThreads) {
+                t.join();
+            }
+        }
+    public:
+        //threads taking part in a loop, the workers and the caller
+        uint32_t get_concurrency() const {
+            return mSlotCount;
+        }
+
+        //runs fn() on some worker, fn may be move-only
+        template<typename _Fn>
+        void execute(_Fn && fn) {
+            using fn_t = typename std::decay<_Fn>::type;
+            fn_t * holder = new fn_t(std::forward<_Fn>(fn));
+            _push(_slot(), task{[](void * ctx, std::size_t, std::size_t) {
+                fn_t * f = static_cast<fn_t *>(ctx);
+                (*f)();
+                delete f;
+            }, holder, 0, 0});
+        }
+
+        //calls fn(i) for every i in [begin, end), or fn(b, e) for subranges.
+        //grain is the smallest range worth a task, 0 picks one from the size.
+        //loops started from outside the pool run one at a time, loops started
+        //from inside a task nest freely.
+        template<typename _Fn>
+        void parallel_for(std::size_t begin, std::size_t end, std::size_t grain, const _Fn & fn) {
+            if (begin >= end) {
+                return;
+            }
+            auto body = [&fn](std::size_t b, std::size_t e) {
+                if constexpr (std::is_invocable<const _Fn &, std::size_t, std::size_t>::value) {
+                    fn(b, e);
+                } else {
+                    for (std::size_t i = b; i < e; ++i) {
+                        fn(i);
+                    }
+                }
+            };
+            _run(begin, end, grain, body);
+        }
+
+        //folds body(i) with combine, or body(b, e) returning the fold of a
+        //subrange. every thread folds into its own cache line and the lines
+        //are combined at the end, so combine must be associative and
+        //commutative, and identity neutral to it.
+        template<typename _T, typename _Body, typename _Combine>
+        _T parallel_reduce(
+                std::size_t begin,
+                std::size_t end,
+                std::size_t grain,
+                const _T & identity,
+                const _Body & body,
+                const _Combine & combine) {
+            std::vector<cache_padded<_T>> partials(mSlotCount, cache_padded<_T>{identity});
+            auto fold = [&](std::size_t b, std::size_t e) {
+                _T acc = identity;
+                if constexpr (std::is_invocable<const _Body &, std::size_t, std::size_t>::value) {
+                    acc = body(b, e);
+                } else {
+                    for (std::size_t i = b; i < e; ++i) {
+                        acc = combine(std::move(acc), body(i));
+                    }
+                }
+                _T & partial = partials[_slot()].value;
+                partial = combine(std::move(partial), std::move(acc));
+            };
+            _run(begin, end, grain, fold);
+            _T result = identity;
+            for (auto & p : partials) {
+                result = combine(std::move(result), std::move(p.value));
+            }
+            return result;
+        }
+    private:
+        struct task
+        {
+            void (*run)(void * ctx, std::size_t begin, std::size_t end);
+            void * ctx;
+            std::size_t begin;
+            std::size_t end;
+        };
+
+        struct alignas(64) slot
+        {
+            mutex_t mutex;
+            std::deque<task> tasks;
+            std::atomic<uint32_t> size = 0;
+        };
+
+        template<typename _Body>
+        struct job
+        {
+            worker_pool * pool;
+            const _Body * body;
+            std::size_t grain;
+            std::atomic<std::size_t> left;
+        };
+
+        struct context
+        {
+            worker_pool * pool = nullptr;
+            uint32_t slot = 0;
+        };
+
+        static context & _context() {
+            static thread_local context ctx;
+            return ctx;
+        }
+
+        uint32_t _slot() {
+            context & ctx = _context();
+            return ctx.pool == this ? ctx.slot : 0;
+        }
+
+        template<typename _Body>
+        void _run(std::size_t begin, std::size_t end, std::size_t grain, const _Body & body) {
+            //an outside caller takes slot 0 for the duration of the loop,
+            //loops it starts from the tasks it runs are then nested ones
+            context & ctx = _context();
+            context saved = ctx;
+            lock_t caller;
+            if (ctx.pool != this) {
+                caller = lock_t(mCallerMutex);
+                ctx.pool = this;
+                ctx.slot = 0;
+            }
+            if (grain == 0) {
+                grain = (end - begin) / (8 * mSlotCount);
+            }
+            job<_Body> j{this, &body, grain == 0 ? 1 : grain, end - begin};
+            _run_range<_Body>(&j, begin, end);
+            uint32_t self = _slot();
+            for (uint32_t idle = 0; j.left.load(std::memory_order_acquire) != 0; ) {
+                if (_run_one(self)) {
+                    idle = 0;
+                } else if (++idle < 64) {
+                    cpu_relax();
+                } else {
+                    std::this_thread::yield();
+                }
+            }
+            ctx = saved;
+        }
+
+        template<typename _Body>
+        static void _run_range(void * ctx, std::size_t b, std::size_t e) {
+            job<_Body> & j = *static_cast<job<_Body> *>(ctx);
+            worker_pool * pool = j.pool;
+            uint32_t self = pool->_slot();
+            while (e - b > j.grain) {
+                if (pool->mSlots[self].size.load(std::memory_order_relaxed) == 0) {
+                    //nothing left for thieves, offer them half
+                    std::size_t mid = b + (e - b) / 2;
+                    pool->_push(self, task{&_run_range<_Body>, ctx, mid, e});
+                    e = mid;
+                } else {
+                    (*j.body)(b, b + j.grain);
+                    j.left.fetch_sub(j.grain, std::memory_order_release);
+                    b += j.grain;
+                }
+            }
+            (*j.body)(b, e);
+            //j may be gone as soon as left hits zero
+            j.left.fetch_sub(e - b, std::memory_order_release);
+        }
+
+        void _push(uint32_t index, const task & t) {
+            slot & s = mSlots[index];
+            {
+                lock_t lock(s.mutex);
+                s.tasks.push_back(t);
+                s.size.store((uint32_t)s.tasks.size(), std::memory_order_relaxed);
+            }
+            mQueued.fetch_add(1, std::memory_order_release);
+            mWait.notify();
+        }
+
+        bool _pop(uint32_t index, task & t, bool own) {
+            slot & s = mSlots[index];
+            if (s.size.load(std::memory_order_relaxed) == 0) {
+                return false;
+            }
+            lock_t lock(s.mutex);
+            if (s.tasks.empty()) {
+                return false;
+            }
+            if (own) {
+                t = s.tasks.back();
+                s.tasks.pop_back();
+            } else {
+                t = s.tasks.front();
+                s.tasks.pop_front();
+            }
+            s.size.store((uint32_t)s.tasks.size(), std::memory_order_relaxed);
+            mQueued.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+
+        bool _run_one(uint32_t self) {
+            task t;
+            bool found = _pop(self, t, true);
+            for (uint32_t i = 1; !found && i < mSlotCount; ++i) {
+                found = _pop((self + i) % mSlotCount, t, false);
+            }
+            if (!found) {
+                return false;
+            }
+            t.run(t.ctx, t.begin, t.end);
+            return true;
+        }
+
+        void _work(uint32_t index) {
+            context & ctx = _context();
+            ctx.pool = this;
+            ctx.slot = index;
+            while (true) {
+                if (_run_one(index)) {
+                    continue;
+                }
+                mWait.wait([this] {
+                    return mQueued.load(std::memory_order_acquire) != 0
+                        || mStopping.load(std::memory_order_acquire);
+                });
+                if (mStopping.load(std::memory_order_acquire) && mQueued.load(std::memory_order_acquire) == 0) {
+                    break;
+                }
+            }
+        }
+    private:
+        uint32_t mSlotCount = 0;
+        std::unique_ptr<slot[]> mSlots;
+        std::vector<std::thread> mThreads;
+        mutex_t mCallerMutex;
+        std::atomic<uint32_t> mQueued = 0;
+        std::atomic<bool> mStopping = false;
+        phased_wait<false> mWait;
+    };
+
+    template<typename _Fn>
+    void parallel_for(worker_pool & pool, std::size_t begin, std::size_t end, std::size_t grain, const _Fn & fn) {
+        pool.parallel_for(begin, end, grain, fn);
+    }
+
+    template<typename _T, typename _Body, typename _Combine>
+    _T parallel_reduce(
+            worker_pool & pool,
+            std::size_t begin,
+            std::size_t end,
+            std::size_t grain,
+            const _T & identity,
+            const _Body & body,
+            const _Combine & combine) {
+        return pool.parallel_reduce(begin, end, grain, identity, body, combine);
+    }
+}
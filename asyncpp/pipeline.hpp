@@ -0,0 +1,503 @@
+#pragma once
+
+#include <atomic>
+#include <array>
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "asyncpp/common.hpp"
+#include "asyncpp/timeout.hpp"
+#include "asyncpp/adv_queue.hpp"
+
+namespace asyncpp
+{
+    //a typed multi-stage pipeline:
+    //
+    //  auto p = source<int>(gen) | stage(parse, 4, 1024) | stage(check) | sink(store);
+    //  p.run();
+    //
+    //every stage runs on parallelism threads, each with its own copy of the
+    //stage function. stages are connected by adv_queues of batches, except
+    //that adjacent stages of parallelism 1 are fused and run on one thread
+    //without a queue in between. a stage returning std::optional<T> emits
+    //nothing for an empty result.
+    //shutdown is ordered: when the source is exhausted or stop() is called,
+    //each queue is drained and then disabled once everything upstream of it
+    //has finished, so no item is lost.
+
+    struct stage_stats
+    {
+        std::string name;
+        uint32_t parallelism = 0;
+        //items that went through the stage function
+        uint64_t items = 0;
+        //time spent in the stage function, summed over threads
+        clock::duration busy = clock::duration::zero();
+        //items per second of wall time
+        double throughput = 0;
+        //busy / (wall time * parallelism), the bottleneck stage is the
+        //one closest to 1
+        double utilization = 0;
+    };
+
+    template<typename _T>
+    struct pipe_unwrap
+    {
+        using type = _T;
+        static constexpr bool optional = false;
+    };
+    template<typename _T>
+    struct pipe_unwrap<std::optional<_T>>
+    {
+        using type = _T;
+        static constexpr bool optional = true;
+    };
+
+    //one step of a pipeline, _In is void for the source, _Out for the sink
+    template<typename _In, typename _Out, typename _Fn>
+    struct pipe_node
+    {
+        using input_t = _In;
+        using output_t = _Out;
+        _Fn fn;
+        uint32_t parallelism = 1;
+        uint32_t capacity = 1024;
+        std::string name;
+    };
+
+    //what stage() and sink() return before they are attached to a pipeline
+    template<typename _Fn, bool _Sink>
+    struct pipe_spec
+    {
+        _Fn fn;
+        uint32_t parallelism;
+        uint32_t capacity;
+        std::string name;
+    };
+
+    //per thread entry of a chain of fused stages
+    template<typename _T>
+    class pipe_input
+    {
+    public:
+        virtual ~pipe_input() = default;
+        virtual void push(_T && item) = 0;
+        //hands on whatever is batched, called after every input batch
+        virtual void flush() = 0;
+    };
+
+    struct pipe_counters
+    {
+        std::atomic<uint64_t> items = 0;
+        std::atomic<int64_t> busy = 0;
+    };
+
+    template<typename _In, typename _Out, typename _Fn>
+    class pipe_call_link : public pipe_input<_In>
+    {
+    public:
+        //the sink has nothing downstream
+        using next_t = typename std::conditional<
+            std::is_void<_Out>::value,
+            std::nullptr_t,
+            std::unique_ptr<pipe_input<_Out>>>::type;
+        pipe_call_link(const _Fn & fn, pipe_counters & counters, next_t && next)
+            : mFn(fn), mCounters(counters), mNext(std::move(next)) {}
+    public:
+        void push(_In && item) override {
+            time_point t0 = clock::now();
+            if constexpr (std::is_void<_Out>::value) {
+                mFn(std::move(item));
+                mBusy += clock::now() - t0;
+                ++mItems;
+            } else {
+                auto result = mFn(std::move(item));
+                mBusy += clock::now() - t0;
+                ++mItems;
+                if constexpr (pipe_unwrap<decltype(result)>::optional) {
+                    if (result.has_value()) {
+                        mNext->push(std::move(*result));
+                    }
+                } else {
+                    mNext->push(std::move(result));
+                }
+            }
+        }
+        void flush() override {
+            mCounters.items.fetch_add(mItems, std::memory_order_relaxed);
+            mCounters.busy.fetch_add(mBusy.count(), std::memory_order_relaxed);
+            mItems = 0;
+            mBusy = clock::duration::zero();
+            if constexpr (!std::is_void<_Out>::value) {
+                mNext->flush();
+            }
+        }
+    private:
+        _Fn mFn;
+        pipe_counters & mCounters;
+        next_t mNext;
+        uint64_t mItems = 0;
+        clock::duration mBusy = clock::duration::zero();
+    };
+
+    template<typename _T>
+    class pipe_queue_link : public pipe_input<_T>
+    {
+    public:
+        pipe_queue_link(adv_queue<std::vector<_T>> & queue, uint32_t batch)
+            : mQueue(queue), mBatchSize(batch) {
+            mBatch.reserve(mBatchSize);
+        }
+    public:
+        void push(_T && item) override {
+            mBatch.emplace_back(std::move(item));
+            if (mBatch.size() >= mBatchSize) {
+                flush();
+            }
+        }
+        void flush() override {
+            if (mBatch.empty()) {
+                return;
+            }
+            mQueue.push(std::move(mBatch));
+            mBatch.clear();
+            mBatch.reserve(mBatchSize);
+        }
+    private:
+        adv_queue<std::vector<_T>> & mQueue;
+        uint32_t mBatchSize;
+        std::vector<_T> mBatch;
+    };
+
+    //the queue in front of a stage, the source has none
+    template<typename _T>
+    struct pipe_queue_slot
+    {
+        using type = std::unique_ptr<adv_queue<std::vector<_T>>>;
+    };
+    template<>
+    struct pipe_queue_slot<void>
+    {
+        using type = std::nullptr_t;
+    };
+
+    template<typename ..._Nodes>
+    class pipeline
+    {
+        static constexpr std::size_t node_count = sizeof...(_Nodes);
+        using nodes_t = std::tuple<_Nodes...>;
+        template<std::size_t _K>
+        using node_t = typename std::tuple_element<_K, nodes_t>::type;
+        template<std::size_t _K>
+        using in_t = typename node_t<_K>::input_t;
+        template<std::size_t _K>
+        using out_t = typename node_t<_K>::output_t;
+        template<typename _T>
+        using queue_t = adv_queue<std::vector<_T>>;
+    public:
+        explicit pipeline(nodes_t && nodes) : mNodes(std::move(nodes)) {
+            _init(std::make_index_sequence<node_count>());
+        }
+        pipeline(const pipeline &) = delete;
+        pipeline & operator = (const pipeline &) = delete;
+        ~pipeline() {
+            if (mStarted && !mFinished) {
+                stop();
+                wait();
+            }
+        }
+    public:
+        //items moved between stages at a time, set before start()
+        result_code set_batch_size(uint32_t size) {
+            if (size == 0) {
+                return result_code::INVALID_ARGUMENTS;
+            }
+            if (mStarted) {
+                return result_code::INCORRECT_STATE;
+            }
+            mBatchSize = size;
+            return result_code::SUCCEED;
+        }
+
+        result_code start() {
+            if (mStarted) {
+                return result_code::INCORRECT_STATE;
+            }
+            mStarted = true;
+            mStart = clock::now();
+            _start(std::make_index_sequence<node_count>());
+            return result_code::SUCCEED;
+        }
+
+        //returns once every item made it through the sink
+        result_code wait() {
+            if (!mStarted) {
+                return result_code::INCORRECT_STATE;
+            }
+            if (mFinished) {
+                return result_code::SUCCEED;
+            }
+            _shutdown(std::make_index_sequence<node_count>());
+            mEnd = clock::now();
+            mFinished = true;
+            return result_code::SUCCEED;
+        }
+
+        result_code run() {
+            result_code res = start();
+            if (res != result_code::SUCCEED) {
+                return res;
+            }
+            return wait();
+        }
+
+        //makes the source stop early, whatever it produced is still delivered
+        void stop() {
+            mStopping.store(true, std::memory_order_relaxed);
+        }
+
+        //whether stage k runs on the threads of the stage before it,
+        //with no queue in between
+        bool is_fused(std::size_t k) const {
+            return k > 0 && mParallelism[k - 1] == 1 && mParallelism[k] == 1;
+        }
+
+        std::vector<stage_stats> get_stats() const {
+            double wall = std::chrono::duration<double>((mFinished ? mEnd : clock::now()) - mStart).count();
+            std::vector<stage_stats> stats(node_count);
+            for (std::size_t k = 0; k < node_count; ++k) {
+                stats[k].name = mNames[k];
+                stats[k].parallelism = mParallelism[k];
+                stats[k].items = mCounters[k].items.load(std::memory_order_relaxed);
+                stats[k].busy = clock::duration(mCounters[k].busy.load(std::memory_order_relaxed));
+                if (mStarted && wall > 0) {
+                    stats[k].throughput = stats[k].items / wall;
+                    stats[k].utilization = std::chrono::duration<double>(stats[k].busy).count()
+                        / (wall * mParallelism[k]);
+                }
+            }
+            return stats;
+        }
+
+        //index of the stage with the highest utilization
+        std::size_t get_bottleneck() const {
+            auto stats = get_stats();
+            std::size_t worst = 0;
+            for (std::size_t k = 1; k < node_count; ++k) {
+                if (stats[k].utilization > stats[worst].utilization) {
+                    worst = k;
+                }
+            }
+            return worst;
+        }
+    private:
+        template<std::size_t ..._Ks>
+        void _init(std::index_sequence<_Ks...>) {
+            ((mParallelism[_Ks] = std::get<_Ks>(mNodes).parallelism), ...);
+            ((mNames[_Ks] = std::get<_Ks>(mNodes).name.empty()
+                ? "stage" + std::to_string(_Ks)
+                : std::get<_Ks>(mNodes).name), ...);
+        }
+
+        template<std::size_t ..._Ks>
+        void _start(std::index_sequence<_Ks...>) {
+            //queues first, threads push into them as soon as they run
+            (_enable_queue<_Ks>(), ...);
+            (_spawn<_Ks>(), ...);
+        }
+
+        template<std::size_t _K>
+        void _enable_queue() {
+            if constexpr (_K > 0) {
+                if (!is_fused(_K)) {
+                    auto & queue = std::get<_K>(mQueues);
+                    queue.reset(new queue_t<in_t<_K>>());
+                    uint32_t capacity = (std::get<_K>(mNodes).capacity + mBatchSize - 1) / mBatchSize;
+                    queue->enable(capacity == 0 ? 1 : capacity);
+                }
+            }
+        }
+
+        template<std::size_t _K>
+        void _spawn() {
+            if (is_fused(_K)) {
+                return;
+            }
+            for (uint32_t i = 0; i < mParallelism[_K]; ++i) {
+                mThreads[_K].emplace_back([this]() {
+                    if constexpr (_K == 0) {
+                        _run_source();
+                    } else {
+                        _run_stage<_K>();
+                    }
+                });
+            }
+        }
+
+        template<std::size_t ..._Ks>
+        void _shutdown(std::index_sequence<_Ks...>) {
+            (_finish<_Ks>(), ...);
+        }
+
+        //everything feeding queue _K + 1 runs on the threads of a stage <= _K,
+        //so once those are joined the queue only has to be drained
+        template<std::size_t _K>
+        void _finish() {
+            for (auto & t : mThreads[_K]) {
+                t.join();
+            }
+            mThreads[_K].clear();
+            if constexpr (_K + 1 < node_count) {
+                if (!is_fused(_K + 1)) {
+                    auto & queue = std::get<_K + 1>(mQueues);
+                    queue->drain();
+                    queue->disable();
+                }
+            }
+        }
+
+        //the chain of links for the thread running stage _K
+        template<std::size_t _K>
+        std::unique_ptr<pipe_input<in_t<_K>>> _make_link() {
+            auto & node = std::get<_K>(mNodes);
+            using fn_t = decltype(node.fn);
+            if constexpr (_K + 1 == node_count) {
+                return std::make_unique<pipe_call_link<in_t<_K>, void, fn_t>>(
+                    node.fn, mCounters[_K], nullptr);
+            } else {
+                return std::make_unique<pipe_call_link<in_t<_K>, out_t<_K>, fn_t>>(
+                    node.fn, mCounters[_K], _make_next<_K>());
+            }
+        }
+
+        template<std::size_t _K>
+        std::unique_ptr<pipe_input<out_t<_K>>> _make_next() {
+            if (is_fused(_K + 1)) {
+                return _make_link<_K + 1>();
+            }
+            return std::make_unique<pipe_queue_link<out_t<_K>>>(*std::get<_K + 1>(mQueues), mBatchSize);
+        }
+
+        void _run_source() {
+            auto & node = std::get<0>(mNodes);
+            auto fn = node.fn;
+            auto next = _make_next<0>();
+            uint64_t items = 0;
+            clock::duration busy = clock::duration::zero();
+            while (!mStopping.load(std::memory_order_relaxed)) {
+                out_t<0> item;
+                time_point t0 = clock::now();
+                bool more = fn(item);
+                busy += clock::now() - t0;
+                if (!more) {
+                    break;
+                }
+                next->push(std::move(item));
+                if (++items == mBatchSize) {
+                    _flush_source(*next, items, busy);
+                }
+            }
+            _flush_source(*next, items, busy);
+        }
+
+        void _flush_source(pipe_input<out_t<0>> & next, uint64_t & items, clock::duration & busy) {
+            mCounters[0].items.fetch_add(items, std::memory_order_relaxed);
+            mCounters[0].busy.fetch_add(busy.count(), std::memory_order_relaxed);
+            items = 0;
+            busy = clock::duration::zero();
+            next.flush();
+        }
+
+        template<std::size_t _K>
+        void _run_stage() {
+            auto & queue = *std::get<_K>(mQueues);
+            auto head = _make_link<_K>();
+            std::vector<in_t<_K>> batch;
+            while (queue.pop(batch) == result_code::SUCCEED) {
+                for (auto & item : batch) {
+                    head->push(std::move(item));
+                }
+                head->flush();
+            }
+        }
+    private:
+        nodes_t mNodes;
+        std::tuple<typename pipe_queue_slot<typename _Nodes::input_t>::type...> mQueues;
+        std::array<std::vector<std::thread>, node_count> mThreads;
+        std::array<pipe_counters, node_count> mCounters;
+        std::array<uint32_t, node_count> mParallelism = {};
+        std::array<std::string, node_count> mNames;
+        uint32_t mBatchSize = 64;
+        std::atomic<bool> mStopping = false;
+        bool mStarted = false;
+        bool mFinished = false;
+        time_point mStart;
+        time_point mEnd;
+    };
+
+    //a pipeline under construction, _Out is what its last stage produces
+    template<typename _Out, typename ..._Nodes>
+    class pipeline_builder
+    {
+    public:
+        explicit pipeline_builder(std::tuple<_Nodes...> && nodes) : mNodes(std::move(nodes)) {}
+    public:
+        template<typename _Fn>
+        auto operator | (pipe_spec<_Fn, false> && spec) && {
+            static_assert(std::is_invocable<_Fn &, _Out &&>::value,
+                "the stage does not accept the output of the previous stage");
+            using result_t = typename std::decay<typename std::invoke_result<_Fn &, _Out &&>::type>::type;
+            static_assert(!std::is_void<result_t>::value, "only the sink may return void");
+            using next_t = typename pipe_unwrap<result_t>::type;
+            using node_t = pipe_node<_Out, next_t, _Fn>;
+            return pipeline_builder<next_t, _Nodes..., node_t>(std::tuple_cat(std::move(mNodes),
+                std::make_tuple(node_t{std::move(spec.fn), spec.parallelism, spec.capacity, std::move(spec.name)})));
+        }
+
+        template<typename _Fn>
+        pipeline<_Nodes..., pipe_node<_Out, void, _Fn>> operator | (pipe_spec<_Fn, true> && spec) && {
+            static_assert(std::is_invocable<_Fn &, _Out &&>::value,
+                "the sink does not accept the output of the previous stage");
+            using node_t = pipe_node<_Out, void, _Fn>;
+            return pipeline<_Nodes..., node_t>(std::tuple_cat(std::move(mNodes),
+                std::make_tuple(node_t{std::move(spec.fn), spec.parallelism, spec.capacity, std::move(spec.name)})));
+        }
+    private:
+        std::tuple<_Nodes...> mNodes;
+    };
+
+    //fn is bool(_Out &), it fills in the next item or returns false when done
+    template<typename _Out, typename _Fn>
+    auto source(_Fn && fn, const std::string & name = "source") {
+        using fn_t = typename std::decay<_Fn>::type;
+        static_assert(std::is_invocable_r<bool, fn_t &, _Out &>::value, "a source is bool(_Out &)");
+        using node_t = pipe_node<void, _Out, fn_t>;
+        return pipeline_builder<_Out, node_t>(std::make_tuple(node_t{std::forward<_Fn>(fn), 1, 0, name}));
+    }
+
+    //capacity is the number of items queued in front of the stage,
+    //unused when the stage is fused with the one before it
+    template<typename _Fn>
+    pipe_spec<typename std::decay<_Fn>::type, false> stage(
+            _Fn && fn,
+            uint32_t parallelism = 1,
+            uint32_t capacity = 1024,
+            const std::string & name = "") {
+        return {std::forward<_Fn>(fn), parallelism == 0 ? 1 : parallelism, capacity, name};
+    }
+
+    template<typename _Fn>
+    pipe_spec<typename std::decay<_Fn>::type, true> sink(
+            _Fn && fn,
+            uint32_t parallelism = 1,
+            uint32_t capacity = 1024,
+            const std::string & name = "sink") {
+        return {std::forward<_Fn>(fn), parallelism == 0 ? 1 : parallelism, capacity, name};
+    }
+}
@@ -10,17 +10,27 @@ using namespace std::chrono;
 
 namespace asyncpp
 {
-    template<bool _InterProcess = false>
+    //_RealTime turns on priority inheritance for the mutex and makes the
+    //condition variable measure timeouts on CLOCK_MONOTONIC
+    template<bool _InterProcess = false, bool _RealTime = false>
     class mutex : public std::mutex {
     public:
         mutex() noexcept {
-            if constexpr (_InterProcess) {
+            if constexpr (_InterProcess || _RealTime) {
                 pthread_mutexattr_t attr;
                 pthread_mutexattr_init(&attr);
-                pthread_mutexattr_setpshared(
-                    &attr, 
-                    PTHREAD_PROCESS_SHARED
-                );
+                if constexpr (_InterProcess) {
+                    pthread_mutexattr_setpshared(
+                        &attr, 
+                        PTHREAD_PROCESS_SHARED
+                    );
+                }
+                if constexpr (_RealTime) {
+                    pthread_mutexattr_setprotocol(
+                        &attr,
+                        PTHREAD_PRIO_INHERIT
+                    );
+                }
                 pthread_mutex_init(native_handle(), &attr);
                 pthread_mutexattr_destroy(&attr);
             }
@@ -32,17 +42,25 @@ namespace asyncpp
         }*/
     };
 
-    template<bool _InterProcess = false>
+    template<bool _InterProcess = false, bool _RealTime = false>
     class condition_variable : public std::condition_variable {
     public:
         condition_variable() noexcept {
-            if constexpr (_InterProcess) {
+            if constexpr (_InterProcess || _RealTime) {
                 pthread_condattr_t attr;
                 pthread_condattr_init(&attr);
-                pthread_condattr_setpshared(
-                    &attr, 
-                    PTHREAD_PROCESS_SHARED
-                );
+                if constexpr (_InterProcess) {
+                    pthread_condattr_setpshared(
+                        &attr, 
+                        PTHREAD_PROCESS_SHARED
+                    );
+                }
+                if constexpr (_RealTime) {
+                    pthread_condattr_setclock(
+                        &attr,
+                        CLOCK_MONOTONIC
+                    );
+                }
                 pthread_cond_init(native_handle(), &attr);
                 pthread_condattr_destroy(&attr);
             }
@@ -51,6 +69,25 @@ namespace asyncpp
         condition_variable & operator=(const condition_variable &) = delete;
     };
 
+    //the lock flavour a primitive is built on, primitives take it as
+    //template<bool _InterProcess> typename _Policy
+    template<bool _InterProcess = false>
+    struct sync_policy
+    {
+        using mutex_t = asyncpp::mutex<_InterProcess>;
+        using cond_t = asyncpp::condition_variable<_InterProcess>;
+        using lock_t = std::unique_lock<std::mutex>;
+    };
+
+    //priority inheritance mutexes for SCHED_FIFO users, see realtime.hpp
+    template<bool _InterProcess = false>
+    struct rt_policy
+    {
+        using mutex_t = asyncpp::mutex<_InterProcess, true>;
+        using cond_t = asyncpp::condition_variable<_InterProcess, true>;
+        using lock_t = std::unique_lock<std::mutex>;
+    };
+
     class thread
     {
     private:
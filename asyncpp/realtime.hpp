@@ -0,0 +1,82 @@
+#pragma once
+
+#include <sys/mman.h>
+#include <unistd.h>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "asyncpp/common.hpp"
+#include "asyncpp/pthread_wrapper.hpp"
+
+namespace asyncpp
+{
+    //helpers to keep page faults out of the real-time path.
+    //run them during start up, before the memory is shared with other threads.
+    struct realtime
+    {
+        static std::size_t page_size() {
+            static const std::size_t size = (std::size_t)sysconf(_SC_PAGESIZE);
+            return size;
+        }
+
+        //touches every page of [addr, addr + len) so it is backed by memory,
+        //the contents are preserved
+        static result_code prefault(void * addr, std::size_t len) {
+            if (addr == nullptr) {
+                return result_code::INVALID_ARGUMENTS;
+            }
+            volatile uint8_t * begin = static_cast<volatile uint8_t *>(addr);
+            std::size_t step = page_size();
+            uintptr_t offset = (uintptr_t)addr % step;
+            for (std::size_t i = 0; i < len; i += (i == 0 ? step - offset : step)) {
+                begin[i] = begin[i];
+            }
+            if (len > 0) {
+                begin[len - 1] = begin[len - 1];
+            }
+            return result_code::SUCCEED;
+        }
+
+        //prefaults and pins the range so it is never paged out
+        static result_code lock(void * addr, std::size_t len) {
+            result_code res = prefault(addr, len);
+            if (res != result_code::SUCCEED) {
+                return res;
+            }
+            return mlock(addr, len) == 0 ? result_code::SUCCEED : result_code::UNAVAILABLE_OR_TIMEOUT;
+        }
+
+        static result_code unlock(void * addr, std::size_t len) {
+            return munlock(addr, len) == 0 ? result_code::SUCCEED : result_code::INVALID_ARGUMENTS;
+        }
+
+        //for primitives whose storage is inline, e.g. queues on flat_ring_queue
+        template<typename _T>
+        static result_code prefault_object(_T & obj) {
+            return prefault(&obj, sizeof(_T));
+        }
+        template<typename _T>
+        static result_code lock_object(_T & obj) {
+            return lock(&obj, sizeof(_T));
+        }
+
+        //pins everything mapped now and later, needs CAP_IPC_LOCK or a
+        //large enough RLIMIT_MEMLOCK
+        static result_code lock_all() {
+            return mlockall(MCL_CURRENT | MCL_FUTURE) == 0
+                ? result_code::SUCCEED
+                : result_code::UNAVAILABLE_OR_TIMEOUT;
+        }
+
+        //grows the calling thread's stack by bytes now rather than on first use
+        __attribute__((noinline))
+        static result_code prefault_stack(std::size_t bytes) {
+            volatile uint8_t * stack = static_cast<volatile uint8_t *>(__builtin_alloca(bytes));
+            for (std::size_t i = 0; i < bytes; i += page_size()) {
+                stack[i] = 0;
+            }
+            return result_code::SUCCEED;
+        }
+    };
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <cstddef>
+#include <array>
+#include <mutex>
+#include <condition_variable>
+
+#include "asyncpp/common.hpp"
+#include "asyncpp/timeout.hpp"
+#include "asyncpp/wait_list.hpp"
+
+namespace asyncpp
+{
+    //the shared waiter a select registers with every primitive it watches
+    class select_waiter
+    {
+    public:
+        select_waiter() = default;
+        select_waiter(const select_waiter &) = delete;
+        select_waiter & operator = (const select_waiter &) = delete;
+    public:
+        using lock_t = std::unique_lock<std::mutex>;
+    public:
+        static void notify(void * context) {
+            select_waiter * waiter = static_cast<select_waiter *>(context);
+            lock_t lock(waiter->mMutex);
+            waiter->mSignaled = true;
+            waiter->mCond.notify_one();
+        }
+        void reset() {
+            lock_t lock(mMutex);
+            mSignaled = false;
+        }
+        result_code wait(const timeout & to) {
+            lock_t lock(mMutex);
+            while (!mSignaled) {
+                if (to.has_value()) {
+                    if (mCond.wait_until(lock, to.value()) == std::cv_status::timeout) {
+                        return mSignaled ? result_code::SUCCEED : result_code::UNAVAILABLE_OR_TIMEOUT;
+                    }
+                } else {
+                    mCond.wait(lock);
+                }
+            }
+            return result_code::SUCCEED;
+        }
+    private:
+        std::mutex mMutex;
+        std::condition_variable mCond;
+        bool mSignaled = false;
+    };
+
+    enum select_policy {
+        //the first ready primitive in argument order wins
+        PRIORITY = 0,
+        //the search starts after the one picked last time
+        ROUND_ROBIN,
+    };
+
+    //blocks until any of the given queues or semaphores is ready and reports
+    //its position in index. readiness is a hint: with several consumers the
+    //following try_pop/try_acquire may still lose the race.
+    //a disabled primitive counts as ready so the caller sees DISABLED.
+    class selector
+    {
+    public:
+        selector(select_policy policy = select_policy::PRIORITY) : mPolicy(policy) {}
+        selector(const selector &) = delete;
+        selector & operator = (const selector &) = delete;
+    public:
+        template<typename ..._Ts>
+        result_code wait_any(std::size_t & index, const timeout & to, _Ts & ...prims) {
+            static_assert(sizeof...(_Ts) > 0, "nothing to wait for");
+            return _wait_any(index, to, typename Range2<0, sizeof...(_Ts)>::seq{}, prims...);
+        }
+    private:
+        template<std::size_t ..._Indices, typename ..._Ts>
+        result_code _wait_any(
+                std::size_t & index,
+                const timeout & to,
+                const Seq<_Indices...> &,
+                _Ts & ...prims) {
+            constexpr std::size_t count = sizeof...(_Ts);
+            select_waiter waiter;
+            std::array<wait_node, count> nodes;
+            for (auto & node : nodes) {
+                node.notify = &select_waiter::notify;
+                node.context = &waiter;
+            }
+            (prims.attach(nodes[_Indices]), ...);
+            result_code res = result_code::SUCCEED;
+            while (true) {
+                waiter.reset();
+                std::array<bool, count> ready = { prims.ready()... };
+                if (_pick(ready, index)) {
+                    break;
+                }
+                if ((res = waiter.wait(to)) != result_code::SUCCEED) {
+                    std::array<bool, count> last = { prims.ready()... };
+                    if (_pick(last, index)) {
+                        res = result_code::SUCCEED;
+                    }
+                    break;
+                }
+            }
+            (prims.detach(nodes[_Indices]), ...);
+            return res;
+        }
+
+        template<std::size_t _Count>
+        bool _pick(const std::array<bool, _Count> & ready, std::size_t & index) {
+            std::size_t start = mPolicy == select_policy::ROUND_ROBIN ? mNext % _Count : 0;
+            for (std::size_t i = 0; i < _Count; ++i) {
+                std::size_t k = (start + i) % _Count;
+                if (ready[k]) {
+                    index = k;
+                    mNext = k + 1;
+                    return true;
+                }
+            }
+            return false;
+        }
+    private:
+        select_policy mPolicy;
+        std::size_t mNext = 0;
+    };
+
+    template<typename ..._Ts>
+    result_code wait_any(std::size_t & index, const timeout & to, _Ts & ...prims) {
+        selector s;
+        return s.wait_any(index, to, prims...);
+    }
+}
@@ -0,0 +1,384 @@
+#pragma once
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/statfs.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <string>
+#include <thread>
+#include <utility>
+
+#include "asyncpp/common.hpp"
+#include "asyncpp/timeout.hpp"
+#include "asyncpp/pthread_wrapper.hpp"
+
+namespace asyncpp
+{
+    //what backs the pages of a segment
+    enum shm_pages {
+        SHM_PAGES_NORMAL = 0,
+        //transparent huge pages, a hint: tmpfs only honours it when
+        ///sys/kernel/mm/transparent_hugepage/shmem_enabled allows
+        SHM_PAGES_TRANSPARENT,
+        //a file on a hugetlbfs mount, fails when no huge pages are reserved
+        SHM_PAGES_HUGETLB,
+    };
+
+    struct shm_options
+    {
+        shm_pages pages = SHM_PAGES_NORMAL;
+        //maps every page up front, so nobody takes first-touch faults later
+        bool prefault = false;
+        //the caller's own layout version, attaching with another one fails
+        uint32_t layout_version = 0;
+        //where SHM_PAGES_HUGETLB segments live
+        const char * hugetlbfs_dir = "/dev/hugepages";
+    };
+
+    //a named shared memory segment holding asyncpp objects by name.
+    //the segment starts with a header: a magic word, the header format,
+    //the caller's layout version and a directory of named objects placed
+    //with a bump allocator. create() builds it, other processes attach()
+    //by name and find() the objects. objects are never destroyed, they
+    //live as long as the segment.
+    class shm_segment
+    {
+    public:
+        static constexpr uint64_t magic = 0x6173796e63707030ull;
+        static constexpr uint32_t format = 1;
+        static constexpr std::size_t max_objects = 64;
+        static constexpr std::size_t max_name = 47;
+    public:
+        shm_segment() = default;
+        shm_segment(const shm_segment &) = delete;
+        shm_segment & operator = (const shm_segment &) = delete;
+        ~shm_segment() {
+            close();
+        }
+    public:
+        //fails with INCORRECT_STATE when a segment of that name exists
+        result_code create(const char * name, std::size_t size, const shm_options & options = shm_options()) {
+            if (mBase != nullptr) {
+                return result_code::INCORRECT_STATE;
+            }
+            if (!_valid_name(name) || size <= sizeof(header)) {
+                return result_code::INVALID_ARGUMENTS;
+            }
+            int fd = _open(name, options, O_CREAT | O_EXCL | O_RDWR);
+            if (fd == -1) {
+                return errno == EEXIST ? result_code::INCORRECT_STATE : result_code::UNAVAILABLE_OR_TIMEOUT;
+            }
+            std::size_t page = _page_size(fd, options);
+            size = (size + page - 1) / page * page;
+            if (ftruncate(fd, (off_t)size) != 0) {
+                ::close(fd);
+                _unlink(name, options);
+                return result_code::UNAVAILABLE_OR_TIMEOUT;
+            }
+            result_code res = _map(fd, size, page, options);
+            ::close(fd);
+            if (res != result_code::SUCCEED) {
+                _unlink(name, options);
+                return res;
+            }
+            header * h = new (mBase) header();
+            h->format = format;
+            h->layout_version = options.layout_version;
+            h->size = size;
+            h->used = _align(sizeof(header), 64);
+            //attachers wait for the magic, it goes in last
+            h->magic.store(magic, std::memory_order_release);
+            return result_code::SUCCEED;
+        }
+
+        //waits until the creator published the header.
+        //INCORRECT_STATE when the segment is no asyncpp segment or its
+        //format or layout version differ from ours
+        result_code attach(const char * name, const shm_options & options = shm_options(), const timeout & to = timeout()) {
+            if (mBase != nullptr) {
+                return result_code::INCORRECT_STATE;
+            }
+            if (!_valid_name(name)) {
+                return result_code::INVALID_ARGUMENTS;
+            }
+            int fd = _open(name, options, O_RDWR);
+            if (fd == -1) {
+                return result_code::UNAVAILABLE_OR_TIMEOUT;
+            }
+            //the creator may not have sized it yet
+            struct stat st;
+            while (true) {
+                if (fstat(fd, &st) != 0) {
+                    ::close(fd);
+                    return result_code::UNAVAILABLE_OR_TIMEOUT;
+                }
+                if ((std::size_t)st.st_size >= sizeof(header)) {
+                    break;
+                }
+                if (to.has_value() && clock::now() >= to.value()) {
+                    ::close(fd);
+                    return result_code::UNAVAILABLE_OR_TIMEOUT;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            result_code res = _map(fd, (std::size_t)st.st_size, _page_size(fd, options), options);
+            ::close(fd);
+            if (res != result_code::SUCCEED) {
+                return res;
+            }
+            header * h = _header();
+            uint64_t m = 0;
+            while ((m = h->magic.load(std::memory_order_acquire)) == 0) {
+                if (to.has_value() && clock::now() >= to.value()) {
+                    close();
+                    return result_code::UNAVAILABLE_OR_TIMEOUT;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            if (m != magic
+                    || h->format != format
+                    || h->layout_version != options.layout_version
+                    || h->size != mSize) {
+                close();
+                return result_code::INCORRECT_STATE;
+            }
+            return result_code::SUCCEED;
+        }
+
+        //unmaps, the segment and its objects stay until remove()
+        void close() {
+            if (mBase != nullptr) {
+                munmap(mBase, mSize);
+                mBase = nullptr;
+                mSize = 0;
+            }
+        }
+
+        static result_code remove(const char * name, const shm_options & options = shm_options()) {
+            if (!_valid_name(name)) {
+                return result_code::INVALID_ARGUMENTS;
+            }
+            return _unlink(name, options) == 0 ? result_code::SUCCEED : result_code::UNAVAILABLE_OR_TIMEOUT;
+        }
+
+        void * get_base() const {
+            return mBase;
+        }
+        std::size_t get_size() const {
+            return mSize;
+        }
+        std::size_t get_free() const {
+            if (mBase == nullptr) {
+                return 0;
+            }
+            header * h = _header();
+            std::lock_guard<std::mutex> lock(h->mutex);
+            return (std::size_t)(h->size - h->used);
+        }
+
+        //constructs a _T named name inside the segment.
+        //INCORRECT_STATE if the name is taken, UNAVAILABLE_OR_TIMEOUT
+        //when the segment or its directory is full
+        template<typename _T, typename ..._Args>
+        result_code construct(const char * name, _T *& obj, _Args && ...args) {
+            if (mBase == nullptr) {
+                return result_code::INCORRECT_STATE;
+            }
+            if (!_valid_name(name)) {
+                return result_code::INVALID_ARGUMENTS;
+            }
+            header * h = _header();
+            std::lock_guard<std::mutex> lock(h->mutex);
+            if (_lookup(h, name) != nullptr) {
+                return result_code::INCORRECT_STATE;
+            }
+            if (h->count == max_objects) {
+                return result_code::UNAVAILABLE_OR_TIMEOUT;
+            }
+            //cache line aligned at least, objects don't share lines
+            std::size_t align = alignof(_T) > 64 ? alignof(_T) : 64;
+            uint64_t offset = _align(h->used, align);
+            if (offset + sizeof(_T) > h->size) {
+                return result_code::UNAVAILABLE_OR_TIMEOUT;
+            }
+            obj = new (static_cast<uint8_t *>(mBase) + offset) _T(std::forward<_Args>(args)...);
+            entry & e = h->entries[h->count];
+            std::strncpy(e.name, name, max_name);
+            e.name[max_name] = '\0';
+            e.offset = offset;
+            e.size = sizeof(_T);
+            e.align = alignof(_T);
+            h->used = offset + sizeof(_T);
+            ++h->count;
+            return result_code::SUCCEED;
+        }
+
+        //UNAVAILABLE_OR_TIMEOUT if there's no such object, INCORRECT_STATE
+        //if it was created with another size or alignment than _T's
+        template<typename _T>
+        result_code find(const char * name, _T *& obj) {
+            if (mBase == nullptr) {
+                return result_code::INCORRECT_STATE;
+            }
+            if (!_valid_name(name)) {
+                return result_code::INVALID_ARGUMENTS;
+            }
+            header * h = _header();
+            std::lock_guard<std::mutex> lock(h->mutex);
+            entry * e = _lookup(h, name);
+            if (e == nullptr) {
+                return result_code::UNAVAILABLE_OR_TIMEOUT;
+            }
+            if (e->size != sizeof(_T) || e->align != alignof(_T)) {
+                return result_code::INCORRECT_STATE;
+            }
+            obj = std::launder(reinterpret_cast<_T *>(static_cast<uint8_t *>(mBase) + e->offset));
+            return result_code::SUCCEED;
+        }
+    private:
+        struct entry
+        {
+            char name[max_name + 1];
+            uint64_t offset;
+            uint64_t size;
+            uint64_t align;
+        };
+
+        struct header
+        {
+            std::atomic<uint64_t> magic = 0;
+            uint32_t format = 0;
+            uint32_t layout_version = 0;
+            uint64_t size = 0;
+            uint64_t used = 0;
+            uint32_t count = 0;
+            asyncpp::mutex<true> mutex;
+            entry entries[max_objects];
+        };
+
+        static constexpr std::size_t huge_page = 2 << 20;
+
+        header * _header() const {
+            return static_cast<header *>(mBase);
+        }
+
+        static uint64_t _align(uint64_t value, uint64_t align) {
+            return (value + align - 1) / align * align;
+        }
+
+        static bool _valid_name(const char * name) {
+            if (name == nullptr) {
+                return false;
+            }
+            std::size_t len = std::strlen(name);
+            return len > 0 && len <= max_name && std::strchr(name, '/') == nullptr;
+        }
+
+        static entry * _lookup(header * h, const char * name) {
+            for (uint32_t i = 0; i < h->count; ++i) {
+                if (std::strncmp(h->entries[i].name, name, max_name) == 0) {
+                    return &h->entries[i];
+                }
+            }
+            return nullptr;
+        }
+
+        static std::string _hugetlb_path(const char * name, const shm_options & options) {
+            return std::string(options.hugetlbfs_dir) + "/" + name;
+        }
+
+        static int _open(const char * name, const shm_options & options, int flags) {
+            if (options.pages == SHM_PAGES_HUGETLB) {
+                return ::open(_hugetlb_path(name, options).c_str(), flags, S_IRUSR | S_IWUSR);
+            }
+            return shm_open((std::string("/") + name).c_str(), flags, S_IRUSR | S_IWUSR);
+        }
+
+        static int _unlink(const char * name, const shm_options & options) {
+            if (options.pages == SHM_PAGES_HUGETLB) {
+                return ::unlink(_hugetlb_path(name, options).c_str());
+            }
+            return shm_unlink((std::string("/") + name).c_str());
+        }
+
+        //the unit sizes are rounded to. hugetlbfs reports its page size as
+        //the block size, transparent huge pages want whole huge pages
+        static std::size_t _page_size(int fd, const shm_options & options) {
+            if (options.pages == SHM_PAGES_HUGETLB) {
+                struct statfs fs;
+                if (fstatfs(fd, &fs) == 0 && fs.f_bsize > 0) {
+                    return (std::size_t)fs.f_bsize;
+                }
+                return huge_page;
+            }
+            if (options.pages == SHM_PAGES_TRANSPARENT) {
+                return huge_page;
+            }
+            return (std::size_t)sysconf(_SC_PAGESIZE);
+        }
+
+        //other processes may be writing, so pages are only read
+        static void _populate(void * addr, std::size_t size) {
+#ifdef MADV_POPULATE_WRITE
+            if (madvise(addr, size, MADV_POPULATE_WRITE) == 0) {
+                return;
+            }
+#endif
+            const volatile uint8_t * p = static_cast<const volatile uint8_t *>(addr);
+            std::size_t step = (std::size_t)sysconf(_SC_PAGESIZE);
+            for (std::size_t i = 0; i < size; i += step) {
+                (void)p[i];
+            }
+        }
+
+        result_code _map(int fd, std::size_t size, std::size_t page, const shm_options & options) {
+            int flags = MAP_SHARED | (options.prefault ? MAP_POPULATE : 0);
+            void * addr = nullptr;
+            if (options.pages == SHM_PAGES_TRANSPARENT) {
+                //huge pages only back huge page aligned ranges: reserve a
+                //larger range and map the segment at an aligned address in it
+                void * reserved = mmap(nullptr, size + page, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+                if (reserved == MAP_FAILED) {
+                    return result_code::UNAVAILABLE_OR_TIMEOUT;
+                }
+                uintptr_t aligned = _align((uintptr_t)reserved, page);
+                std::size_t head = aligned - (uintptr_t)reserved;
+                if (head > 0) {
+                    munmap(reserved, head);
+                }
+                if (page - head > 0) {
+                    munmap((void *)(aligned + size), page - head);
+                }
+                //advised before populating so the faults can take huge pages
+                addr = mmap((void *)aligned, size, PROT_READ | PROT_WRITE, (flags & ~MAP_POPULATE) | MAP_FIXED, fd, 0);
+                if (addr == MAP_FAILED) {
+                    munmap((void *)aligned, size);
+                    return result_code::UNAVAILABLE_OR_TIMEOUT;
+                }
+                madvise(addr, size, MADV_HUGEPAGE);
+                if (options.prefault) {
+                    _populate(addr, size);
+                }
+            } else {
+                addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, flags, fd, 0);
+                if (addr == MAP_FAILED) {
+                    return result_code::UNAVAILABLE_OR_TIMEOUT;
+                }
+            }
+            mBase = addr;
+            mSize = size;
+            return result_code::SUCCEED;
+        }
+    private:
+        void * mBase = nullptr;
+        std::size_t mSize = 0;
+    };
+}
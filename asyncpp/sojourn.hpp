@@ -0,0 +1,60 @@
+#pragma once
+
+#include <type_traits>
+
+#include "asyncpp/timeout.hpp"
+#include "asyncpp/histogram.hpp"
+
+namespace asyncpp
+{
+    //an item together with the time it was queued.
+    //a queue whose container holds stamped<_Item>, e.g.
+    //adv_queue<_Item, false, std::list<stamped<_Item>>>, stamps every push
+    //and records the time spent in the queue at pop.
+    template<typename _Item>
+    struct stamped
+    {
+        _Item item;
+        time_point stamp;
+    };
+
+    template<typename _T>
+    struct is_stamped : public std::false_type {};
+    template<typename _Item>
+    struct is_stamped<stamped<_Item>> : public std::true_type {};
+
+    //stands in for the histogram of queues that do not track sojourn time
+    struct no_sojourn {};
+
+    //container glue used by the queues
+    template<typename _Item, typename _Queue>
+    struct sojourn_traits
+    {
+        static constexpr bool tracked = is_stamped<typename _Queue::value_type>::value;
+        using histogram_t = typename std::conditional<tracked, latency_histogram, no_sojourn>::type;
+
+        template<typename _T>
+        static void put(_Queue & queue, _T && item) {
+            if constexpr (tracked) {
+                queue.emplace_back(stamped<_Item>{std::forward<_T>(item), clock::now()});
+            } else {
+                queue.emplace_back(std::forward<_T>(item));
+            }
+        }
+
+        //returns the time the item spent queued, zero when untracked
+        static clock::duration take(_Queue & queue, _Item & item, histogram_t & histogram) {
+            clock::duration sojourn = clock::duration::zero();
+            if constexpr (tracked) {
+                auto & front = queue.front();
+                item = std::move(front.item);
+                sojourn = clock::now() - front.stamp;
+                histogram.record((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(sojourn).count());
+            } else {
+                item = std::move(queue.front());
+            }
+            queue.pop_front();
+            return sojourn;
+        }
+    };
+}
@@ -1,90 +1,150 @@
 #pragma once
 
+#include <atomic>
+#include <cstdint>
+
 #include <asyncpp/common.hpp>
-#include <asyncpp/pthread_wrapper.hpp>
-#include <asyncpp/adv_semaphore.hpp>
 #include <asyncpp/timeout.hpp>
+#include <asyncpp/wait_strategy.hpp>
 
 namespace asyncpp
 {
-    template<typename _Item, bool _InterProcess = false>
+    //rendezvous channel: push returns once a consumer has taken the item.
+    //the hand over is an exchange on one state word sitting on the same
+    //cache line as the item, waiting spins briefly and then parks.
+    template<
+        typename _Item,
+        bool _InterProcess = false,
+        typename _Wait = phased_wait<_InterProcess>>
     class sync_queue
     {
     public:
         sync_queue() = default;
         sync_queue(const sync_queue &) = delete;
         sync_queue & operator = (const sync_queue &) = delete;
-    public:
-        using mutex_t = asyncpp::mutex<_InterProcess>;
-        using lock_t = std::unique_lock<std::mutex>;
     public:
         result_code enable() {
-            lock_t lock(mMutex);
-            mEnabled = true;
-            mPushSem.set_value(1);
-            mPopSem.set_value(0);
-            mPushSem.enable();
-            mPopSem.enable();
+            mSlot.state.store(0, std::memory_order_relaxed);
+            mEnabled.store(true, std::memory_order_release);
             return result_code::SUCCEED;
         }
         void disable() {
-            lock_t lock(mMutex);
-            mEnabled = false;
-            mPushSem.disable();
-            mPopSem.disable();
+            mEnabled.store(false, std::memory_order_release);
+            mWait.notify();
         }
 
         result_code push(const _Item & item, const timeout & to = timeout()) {
-            result_code res = result_code::SUCCEED;
-            if ((res = mPushSem.block_and_acquire(1, nullptr, to)) != result_code::SUCCEED) {
-                return res;
-            }
-            {
-                mBuf = item;
-            }
-            if ((res = mPopSem.release(1)) != result_code::SUCCEED) {
-                return res;
-            }
-            if ((res = mPushSem.reserve_and_unblock(1, nullptr, to)) != result_code::SUCCEED) {
-                return res;
-            }
-            return result_code::SUCCEED;
+            return _push([&](_Item & buf) { buf = item; }, to);
         }
         result_code push(_Item && item, const timeout & to = timeout()) {
-            result_code res = result_code::SUCCEED;
-            if ((res = mPushSem.block_and_acquire(1, to)) != result_code::SUCCEED) {
-                return res;
+            return _push([&](_Item & buf) { buf = std::move(item); }, to);
+        }
+
+        result_code pop(_Item & item, const timeout & to = timeout()) {
+            if (!_enabled()) {
+                return result_code::DISABLED;
             }
-            {
-                mBuf = std::move(item);
+            uint64_t state = 0;
+            bool claimed = false;
+            result_code res = mWait.wait([&] {
+                return !_enabled() || (claimed = _claim(state, FULL, READING));
+            }, to);
+            if (!claimed) {
+                return res != result_code::SUCCEED ? res : result_code::DISABLED;
             }
-            if ((res = mPopSem.release()) != result_code::SUCCEED) {
-                return res;
+            item = std::move(mSlot.buf);
+            mSlot.state.store(_next(state), std::memory_order_release);
+            mWait.notify();
+            return result_code::SUCCEED;
+        }
+        result_code try_pop(_Item & item) {
+            if (!_enabled()) {
+                return result_code::DISABLED;
             }
-            if ((res = mPushSem.reserve_and_unblock(1, to)) != result_code::SUCCEED) {
-                return res;
+            uint64_t state = 0;
+            if (!_claim(state, FULL, READING)) {
+                return result_code::UNAVAILABLE_OR_TIMEOUT;
             }
+            item = std::move(mSlot.buf);
+            mSlot.state.store(_next(state), std::memory_order_release);
+            mWait.notify();
             return result_code::SUCCEED;
         }
+    private:
+        //the state word is generation << 2 | phase
+        enum phase : uint64_t {
+            EMPTY = 0,
+            WRITING = 1,
+            FULL = 2,
+            READING = 3,
+        };
 
-        result_code pop(_Item & item, const timeout & to = timeout()) {
-            result_code res = result_code::SUCCEED;
-            if ((res = mPopSem.acquire(nullptr, to)) != result_code::SUCCEED) {
-                return res;
+        static inline uint64_t _phase(uint64_t state) {
+            return state & 3;
+        }
+        static inline uint64_t _next(uint64_t state) {
+            return ((state >> 2) + 1) << 2;
+        }
+
+        inline bool _enabled() const {
+            return mEnabled.load(std::memory_order_acquire);
+        }
+
+        //moves the slot from one phase to another within the same generation
+        bool _claim(uint64_t & state, phase from, phase to) {
+            state = mSlot.state.load(std::memory_order_acquire);
+            if (_phase(state) != from) {
+                return false;
+            }
+            return mSlot.state.compare_exchange_strong(
+                state, (state & ~(uint64_t)3) | to,
+                std::memory_order_acquire, std::memory_order_relaxed);
+        }
+
+        template<typename _Assign>
+        result_code _push(const _Assign & assign, const timeout & to) {
+            if (!_enabled()) {
+                return result_code::DISABLED;
+            }
+            uint64_t state = 0;
+            bool claimed = false;
+            result_code res = mWait.wait([&] {
+                return !_enabled() || (claimed = _claim(state, EMPTY, WRITING));
+            }, to);
+            if (!claimed) {
+                return res != result_code::SUCCEED ? res : result_code::DISABLED;
             }
-            {
-                item = std::move(mBuf);
+            assign(mSlot.buf);
+            uint64_t full = (state & ~(uint64_t)3) | FULL;
+            mSlot.state.store(full, std::memory_order_release);
+            mWait.notify();
+            //the item is taken once the generation moves on
+            auto taken = [&] {
+                return (mSlot.state.load(std::memory_order_acquire) >> 2) != (state >> 2);
+            };
+            res = mWait.wait([&] { return !_enabled() || taken(); }, to);
+            if (taken()) {
+                return result_code::SUCCEED;
             }
-            if ((res = mPushSem.release()) != result_code::SUCCEED) {
-                return res;
+            //take the item back unless a consumer is reading it right now
+            uint64_t expected = full;
+            if (mSlot.state.compare_exchange_strong(
+                    expected, state & ~(uint64_t)3,
+                    std::memory_order_acq_rel, std::memory_order_acquire)) {
+                mWait.notify();
+                return res != result_code::SUCCEED ? res : result_code::DISABLED;
             }
+            mWait.wait(taken);
             return result_code::SUCCEED;
         }
     private:
-        mutex_t mMutex;
-        bool mEnabled = false;
-        _Item mBuf;
-        adv_semaphore<_InterProcess> mPushSem;
-        adv_semaphore<_InterProcess> mPopSem;
+        struct alignas(64) slot
+        {
+            std::atomic<uint64_t> state = 0;
+            _Item buf;
+        };
+        slot mSlot;
+        std::atomic<bool> mEnabled = false;
+        _Wait mWait;
     };
-}
\ No newline at end of file
+}
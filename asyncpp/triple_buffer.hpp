@@ -0,0 +1,77 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <type_traits>
+
+#include "asyncpp/common.hpp"
+
+namespace asyncpp
+{
+    //latest value mailbox for one writer and one reader.
+    //three slots rotate between the writer, the reader and the middle, so
+    //publish() and read_latest() are wait-free and never see a torn value.
+    //old values are overwritten, not queued.
+    template<typename _Item, bool _InterProcess = false>
+    class triple_buffer
+    {
+        static_assert(!_InterProcess || std::is_trivially_copyable<_Item>::value,
+            "process shared items must be trivially copyable");
+        static_assert(std::atomic<uint32_t>::is_always_lock_free, "lock free atomics required");
+    public:
+        triple_buffer() = default;
+        triple_buffer(const triple_buffer &) = delete;
+        triple_buffer & operator = (const triple_buffer &) = delete;
+    public:
+        //writer side
+        void publish(const _Item & item) {
+            mSlots[mBack].item = item;
+            _swap_back();
+        }
+        void publish(_Item && item) {
+            mSlots[mBack].item = std::move(item);
+            _swap_back();
+        }
+
+        //reader side
+        bool has_new() const {
+            return (mMiddle.load(std::memory_order_acquire) & DIRTY) != 0;
+        }
+
+        //copies the newest published value, which may be the one read last time
+        result_code read_latest(_Item & item) {
+            if (has_new()) {
+                uint32_t middle = mMiddle.exchange(mFront, std::memory_order_acq_rel);
+                mFront = middle & INDEX;
+                mHasValue = true;
+            }
+            if (!mHasValue) {
+                return result_code::UNAVAILABLE_OR_TIMEOUT;
+            }
+            item = mSlots[mFront].item;
+            return result_code::SUCCEED;
+        }
+    private:
+        enum : uint32_t {
+            INDEX = 0x3,
+            DIRTY = 0x4,
+        };
+
+        void _swap_back() {
+            uint32_t middle = mMiddle.exchange(mBack | DIRTY, std::memory_order_acq_rel);
+            mBack = middle & INDEX;
+        }
+    private:
+        struct alignas(64) slot
+        {
+            _Item item;
+        };
+        slot mSlots[3];
+        alignas(64) std::atomic<uint32_t> mMiddle = 1;
+        //owned by the writer
+        alignas(64) uint32_t mBack = 0;
+        //owned by the reader
+        alignas(64) uint32_t mFront = 2;
+        bool mHasValue = false;
+    };
+}
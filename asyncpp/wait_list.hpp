@@ -0,0 +1,55 @@
+#pragma once
+
+namespace asyncpp
+{
+    //a node a primitive calls back when it may have become ready.
+    //the callback runs under the primitive's lock, it must be short and
+    //must not call back into the primitive.
+    struct wait_node
+    {
+        wait_node * prev = nullptr;
+        wait_node * next = nullptr;
+        void (*notify)(void * context) = nullptr;
+        void * context = nullptr;
+    };
+
+    //intrusive list of wait_nodes, guarded by the owner's lock.
+    //nodes hold raw pointers so it is only usable within one process.
+    class wait_list
+    {
+    public:
+        wait_list() = default;
+        wait_list(const wait_list &) = delete;
+        wait_list & operator = (const wait_list &) = delete;
+    public:
+        bool empty() const {
+            return mHead == nullptr;
+        }
+        void attach(wait_node * node) {
+            node->prev = nullptr;
+            node->next = mHead;
+            if (mHead != nullptr) {
+                mHead->prev = node;
+            }
+            mHead = node;
+        }
+        void detach(wait_node * node) {
+            if (node->prev != nullptr) {
+                node->prev->next = node->next;
+            } else if (mHead == node) {
+                mHead = node->next;
+            }
+            if (node->next != nullptr) {
+                node->next->prev = node->prev;
+            }
+            node->prev = node->next = nullptr;
+        }
+        void notify_all() const {
+            for (wait_node * node = mHead; node != nullptr; node = node->next) {
+                node->notify(node->context);
+            }
+        }
+    private:
+        wait_node * mHead = nullptr;
+    };
+}
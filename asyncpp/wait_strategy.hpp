@@ -0,0 +1,145 @@
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include <cstdint>
+
+#include "asyncpp/common.hpp"
+#include "asyncpp/timeout.hpp"
+#include "asyncpp/pthread_wrapper.hpp"
+
+namespace asyncpp
+{
+    inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#elif defined(__aarch64__)
+        asm volatile("yield" ::: "memory");
+#endif
+    }
+
+    //wait strategies park a thread until a predicate over atomics turns true.
+    //whoever changes the state observed by the predicate calls notify() after
+    //the change has been stored.
+
+    //burns the cpu, lowest latency, only for dedicated cores
+    class spin_wait
+    {
+    public:
+        template<typename _Pred>
+        result_code wait(const _Pred & ready, const timeout & to = timeout()) {
+            for (uint32_t i = 1; !ready(); ++i) {
+                cpu_relax();
+                if ((i & 0xff) == 0 && to.has_value() && clock::now() >= to.value()) {
+                    return ready() ? result_code::SUCCEED : result_code::UNAVAILABLE_OR_TIMEOUT;
+                }
+            }
+            return result_code::SUCCEED;
+        }
+        void notify() {}
+    };
+
+    //gives the core away between polls but never sleeps in the kernel
+    class yield_wait
+    {
+    public:
+        template<typename _Pred>
+        result_code wait(const _Pred & ready, const timeout & to = timeout()) {
+            for (uint32_t i = 1; !ready(); ++i) {
+                std::this_thread::yield();
+                if ((i & 0xf) == 0 && to.has_value() && clock::now() >= to.value()) {
+                    return ready() ? result_code::SUCCEED : result_code::UNAVAILABLE_OR_TIMEOUT;
+                }
+            }
+            return result_code::SUCCEED;
+        }
+        void notify() {}
+    };
+
+    //parks on a condvar; notify() only touches the mutex when someone is parked
+    template<bool _InterProcess = false, template<bool> typename _Policy = sync_policy>
+    class blocking_wait
+    {
+    public:
+        blocking_wait() = default;
+        blocking_wait(const blocking_wait &) = delete;
+        blocking_wait & operator = (const blocking_wait &) = delete;
+    public:
+        using mutex_t = typename _Policy<_InterProcess>::mutex_t;
+        using cond_t = typename _Policy<_InterProcess>::cond_t;
+        using lock_t = typename _Policy<_InterProcess>::lock_t;
+    public:
+        template<typename _Pred>
+        result_code wait(const _Pred & ready, const timeout & to = timeout()) {
+            if (ready()) {
+                return result_code::SUCCEED;
+            }
+            lock_t lock(mMutex);
+            mWaiters.fetch_add(1, std::memory_order_relaxed);
+            //pairs with the fence in notify(), either we see the new state
+            //or the notifier sees our waiter count
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            result_code res = result_code::SUCCEED;
+            while (!ready()) {
+                if (to.has_value()) {
+                    if (mCond.wait_until(lock, to.value()) == std::cv_status::timeout) {
+                        if (!ready()) {
+                            res = result_code::UNAVAILABLE_OR_TIMEOUT;
+                        }
+                        break;
+                    }
+                } else {
+                    mCond.wait(lock);
+                }
+            }
+            mWaiters.fetch_sub(1, std::memory_order_relaxed);
+            return res;
+        }
+        void notify() {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (mWaiters.load(std::memory_order_relaxed) == 0) {
+                return;
+            }
+            {
+                lock_t lock(mMutex);
+            }
+            mCond.notify_all();
+        }
+    private:
+        std::atomic<uint32_t> mWaiters = 0;
+        mutex_t mMutex;
+        cond_t mCond;
+    };
+
+    //spins, then yields, then parks
+    template<
+        bool _InterProcess = false,
+        uint32_t _Spins = 128,
+        uint32_t _Yields = 16,
+        template<bool> typename _Policy = sync_policy>
+    class phased_wait
+    {
+    public:
+        template<typename _Pred>
+        result_code wait(const _Pred & ready, const timeout & to = timeout()) {
+            for (uint32_t i = 0; i < _Spins; ++i) {
+                if (ready()) {
+                    return result_code::SUCCEED;
+                }
+                cpu_relax();
+            }
+            for (uint32_t i = 0; i < _Yields; ++i) {
+                if (ready()) {
+                    return result_code::SUCCEED;
+                }
+                std::this_thread::yield();
+            }
+            return mBlocking.wait(ready, to);
+        }
+        void notify() {
+            mBlocking.notify();
+        }
+    private:
+        blocking_wait<_InterProcess, _Policy> mBlocking;
+    };
+}
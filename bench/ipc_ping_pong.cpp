@@ -0,0 +1,298 @@
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <asyncpp/adv_queue.hpp>
+#include <asyncpp/basic_semaphore.hpp>
+#include <asyncpp/sync_queue.hpp>
+#include <asyncpp/byte_ring.hpp>
+#include <asyncpp/flat_ring_queue.hpp>
+#include <asyncpp/histogram.hpp>
+#include <chrono>
+#include <new>
+#include <thread>
+
+//two processes over shared memory: the parent sends a value through the
+//ping channel and the child echoes it through the pong channel.
+//reports the round trip distribution, then the one way throughput of
+//the parent streaming values to the child.
+//
+//  ipc_ping_pong [-c queue|semaphore|sync|ring|all] [-n rounds]
+//                [-m messages] [-p parent_cpu,child_cpu] [-s]
+//
+//-s polls the try_ flavours with cpu_relax() instead of blocking: lowest
+//latency with a core for each side, and a disaster on a shared one.
+
+using asyncpp::result_code;
+
+struct options
+{
+    const char * channel = "all";
+    uint64_t rounds = 100000;
+    uint64_t messages = 1000000;
+    int cpus[2] = {-1, -1};
+    bool spin = false;
+};
+
+struct queue_channel
+{
+    static constexpr const char * key = "queue";
+    static constexpr const char * name = "adv_queue<flat_ring_queue>";
+    asyncpp::adv_queue<uint64_t, true, asyncpp::flat_ring_queue<uint64_t, 1025>> queue;
+
+    void open() {
+        queue.enable(1024);
+    }
+    void close() {
+        queue.disable();
+    }
+    result_code send(uint64_t value) {
+        return queue.push(value);
+    }
+    result_code recv(uint64_t & value) {
+        return queue.pop(value);
+    }
+    result_code try_recv(uint64_t & value) {
+        return queue.try_pop(value);
+    }
+};
+
+//carries no data, the echo is the permit itself
+struct semaphore_channel
+{
+    static constexpr const char * key = "semaphore";
+    static constexpr const char * name = "basic_semaphore";
+    asyncpp::basic_semaphore<true> sem;
+
+    void open() {
+        sem.set_value(0);
+        sem.enable();
+    }
+    void close() {
+        sem.disable();
+    }
+    result_code send(uint64_t) {
+        return sem.release();
+    }
+    result_code recv(uint64_t &) {
+        return sem.acquire();
+    }
+    result_code try_recv(uint64_t &) {
+        return sem.try_acquire();
+    }
+};
+
+struct sync_channel
+{
+    static constexpr const char * key = "sync";
+    static constexpr const char * name = "sync_queue";
+    asyncpp::sync_queue<uint64_t, true> queue;
+
+    void open() {
+        queue.enable();
+    }
+    void close() {
+        queue.disable();
+    }
+    result_code send(uint64_t value) {
+        return queue.push(value);
+    }
+    result_code recv(uint64_t & value) {
+        return queue.pop(value);
+    }
+    result_code try_recv(uint64_t & value) {
+        return queue.try_pop(value);
+    }
+};
+
+//writers and readers are each serialized by a process shared mutex,
+//waiting for room or records goes through phased_wait
+struct ring_channel
+{
+    static constexpr const char * key = "ring";
+    static constexpr const char * name = "byte_ring";
+    asyncpp::byte_ring<1 << 16, true> ring;
+
+    void open() {
+        ring.enable();
+    }
+    void close() {
+        ring.disable();
+    }
+    result_code send(uint64_t value) {
+        return ring.push(&value, sizeof(value));
+    }
+    result_code recv(uint64_t & value) {
+        const void * data = nullptr;
+        std::size_t size = 0;
+        result_code res = ring.read(data, size);
+        return res == result_code::SUCCEED ? _take(data, value) : res;
+    }
+    result_code try_recv(uint64_t & value) {
+        const void * data = nullptr;
+        std::size_t size = 0;
+        result_code res = ring.try_read(data, size);
+        return res == result_code::SUCCEED ? _take(data, value) : res;
+    }
+    result_code _take(const void * data, uint64_t & value) {
+        memcpy(&value, data, sizeof(value));
+        ring.release();
+        return result_code::SUCCEED;
+    }
+};
+
+template<typename _Channel>
+struct shared_pair
+{
+    _Channel ping;
+    _Channel pong;
+};
+
+template<typename _Channel>
+static result_code receive(_Channel & channel, uint64_t & value, bool spin) {
+    if (!spin) {
+        return channel.recv(value);
+    }
+    while (true) {
+        result_code res = channel.try_recv(value);
+        if (res != result_code::UNAVAILABLE_OR_TIMEOUT) {
+            return res;
+        }
+        asyncpp::cpu_relax();
+    }
+}
+
+static void pin(int cpu) {
+    if (cpu < 0) {
+        return;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+        printf("pinning to cpu %d failed\n", cpu);
+    }
+}
+
+template<typename _Channel>
+static void child_side(shared_pair<_Channel> & shared, const options & opts) {
+    pin(opts.cpus[1]);
+    uint64_t value = 0;
+    for (uint64_t i = 0; i < opts.rounds; ++i) {
+        if (receive(shared.ping, value, opts.spin) != result_code::SUCCEED) {
+            return;
+        }
+        shared.pong.send(value);
+    }
+    uint64_t last = 0;
+    for (uint64_t i = 0; i < opts.messages; ++i) {
+        if (receive(shared.ping, last, opts.spin) != result_code::SUCCEED) {
+            return;
+        }
+    }
+    //the ack tells the parent everything has arrived
+    shared.pong.send(last);
+}
+
+template<typename _Channel>
+static void parent_side(shared_pair<_Channel> & shared, const options & opts) {
+    pin(opts.cpus[0]);
+    asyncpp::latency_histogram rtt;
+    uint64_t value = 0;
+    for (uint64_t i = 0; i < opts.rounds; ++i) {
+        auto t0 = std::chrono::steady_clock::now();
+        shared.ping.send(i);
+        if (receive(shared.pong, value, opts.spin) != result_code::SUCCEED) {
+            printf("%s: echo lost at round %lu\n", _Channel::name, i);
+            return;
+        }
+        auto t1 = std::chrono::steady_clock::now();
+        rtt.record((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count());
+    }
+    auto t0 = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < opts.messages; ++i) {
+        shared.ping.send(i);
+    }
+    receive(shared.pong, value, opts.spin);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    printf("%-28s rtt ns p50 %6lu p99 %7lu p99.99 %8lu max %9lu | one way %6.2f M msg/s\n",
+        _Channel::name, rtt.p50(), rtt.p99(), rtt.get_percentile(0.9999), rtt.get_max(),
+        opts.messages / seconds / 1e6);
+}
+
+template<typename _Channel>
+static void run(const options & opts) {
+    if (strcmp(opts.channel, "all") != 0 && strcmp(_Channel::key, opts.channel) != 0) {
+        return;
+    }
+    void * ptr = mmap(NULL, sizeof(shared_pair<_Channel>), PROT_READ|PROT_WRITE,
+        MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+    if (ptr == MAP_FAILED) {
+        printf("mmap failed\n");
+        return;
+    }
+    auto * shared = new(ptr) shared_pair<_Channel>();
+    shared->ping.open();
+    shared->pong.open();
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        child_side(*shared, opts);
+        _exit(0);
+    } else if (pid > 0) {
+        parent_side(*shared, opts);
+        shared->ping.close();
+        shared->pong.close();
+        waitpid(pid, NULL, 0);
+    } else {
+        printf("fork failed\n");
+    }
+    shared->~shared_pair<_Channel>();
+    munmap(ptr, sizeof(shared_pair<_Channel>));
+}
+
+int main(int argc, char ** argv) {
+    options opts;
+    int opt = 0;
+    while ((opt = getopt(argc, argv, "c:n:m:p:s")) != -1) {
+        switch (opt) {
+        case 'c':
+            opts.channel = optarg;
+            break;
+        case 'n':
+            opts.rounds = strtoull(optarg, nullptr, 10);
+            break;
+        case 'm':
+            opts.messages = strtoull(optarg, nullptr, 10);
+            break;
+        case 'p':
+            if (sscanf(optarg, "%d,%d", &opts.cpus[0], &opts.cpus[1]) != 2) {
+                printf("-p takes parent_cpu,child_cpu\n");
+                return 1;
+            }
+            break;
+        case 's':
+            opts.spin = true;
+            break;
+        default:
+            printf("usage: %s [-c queue|semaphore|sync|ring|all] [-n rounds] "
+                "[-m messages] [-p parent_cpu,child_cpu] [-s]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (opts.spin && std::thread::hardware_concurrency() < 2) {
+        printf("warning: spinning on a single cpu, each miss costs a time slice\n");
+    }
+    printf("%s consumers, %lu rounds, %lu messages, cpus %d,%d\n",
+        opts.spin ? "spinning" : "blocking", opts.rounds, opts.messages, opts.cpus[0], opts.cpus[1]);
+    run<queue_channel>(opts);
+    run<semaphore_channel>(opts);
+    run<sync_channel>(opts);
+    run<ring_channel>(opts);
+    return 0;
+}
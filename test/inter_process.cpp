@@ -3,13 +3,19 @@
 #include <sys/stat.h>        /* For mode constants */
 #include <fcntl.h>           /* For O_* constants */
 #include <unistd.h>
+#include <sys/wait.h>
 
 #include <stdio.h>
 
 #include <asyncpp/adv_queue.hpp>
 #include <asyncpp/flat_ring_queue.hpp>
+#include <asyncpp/triple_buffer.hpp>
+#include <asyncpp/byte_ring.hpp>
+#include <asyncpp/shm_segment.hpp>
+#include <asyncpp/object_pool.hpp>
 #include <thread>
 #include <chrono>
+#include <atomic>
 
 struct Shared
 {
@@ -71,4 +77,307 @@ void test_inter_proc()
     }
     munmap(ptr, sizeof(Shared));
     close(fd);
-}
\ No newline at end of file
+}
+
+struct Snapshot
+{
+    uint64_t seq = 0;
+    uint64_t check = 0;
+};
+
+struct SharedMailbox
+{
+    asyncpp::triple_buffer<Snapshot, true> mailbox;
+    std::atomic<bool> done = false;
+};
+
+void test_inter_proc_triple_buffer()
+{
+    int fd = shm_open("test_shared_mailbox", O_CREAT|O_RDWR, S_IRUSR|S_IWUSR);
+    if (fd == -1) {
+        printf("shm_open failed\n");
+        return;
+    }
+    ftruncate(fd, sizeof(SharedMailbox));
+    void * ptr = mmap(NULL, sizeof(SharedMailbox), PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+    if (ptr == (void *)(-1)) {
+        printf("mmap failed\n");
+        return;
+    }
+    SharedMailbox * shared = new(ptr) SharedMailbox();
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        uint64_t reads = 0;
+        uint64_t last = 0;
+        uint32_t errors = 0;
+        Snapshot snap;
+        while (!shared->done.load()) {
+            if (!shared->mailbox.has_new()) {
+                continue;
+            }
+            if (shared->mailbox.read_latest(snap) != asyncpp::result_code::SUCCEED) {
+                continue;
+            }
+            if (snap.seq < last || snap.check != ~snap.seq) {
+                ++errors;
+            }
+            last = snap.seq;
+            ++reads;
+        }
+        printf("child: %lu reads, last %lu, %u errors\n", reads, last, errors);
+        fflush(stdout);
+        munmap(ptr, sizeof(SharedMailbox));
+        close(fd);
+        _exit(0);
+    } else if (pid > 0) {
+        auto t0 = std::chrono::steady_clock::now();
+        uint64_t seq = 0;
+        while (std::chrono::steady_clock::now() - t0 < std::chrono::seconds(1)) {
+            ++seq;
+            shared->mailbox.publish(Snapshot{seq, ~seq});
+        }
+        shared->done = true;
+        waitpid(pid, NULL, 0);
+        printf("parent: published %lu\n", seq);
+    } else {
+        printf("fork failed\n");
+    }
+    munmap(ptr, sizeof(SharedMailbox));
+    close(fd);
+    shm_unlink("test_shared_mailbox");
+}
+
+using MessageRing = asyncpp::byte_ring<1 << 20, true>;
+
+//deterministic message sizes between 64 B and 64 KB, mostly small
+static std::size_t message_size(uint64_t seq) {
+    uint64_t x = seq * 0x9E3779B97F4A7C15ull;
+    return (x >> 60) == 0 ? 4096 + (x >> 20) % (60 * 1024) : 64 + (x >> 20) % 960;
+}
+
+void test_inter_proc_byte_ring()
+{
+    int fd = shm_open("test_shared_ring", O_CREAT|O_RDWR, S_IRUSR|S_IWUSR);
+    if (fd == -1) {
+        printf("shm_open failed\n");
+        return;
+    }
+    ftruncate(fd, sizeof(MessageRing));
+    void * ptr = mmap(NULL, sizeof(MessageRing), PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+    if (ptr == (void *)(-1)) {
+        printf("mmap failed\n");
+        return;
+    }
+    MessageRing * ring = new(ptr) MessageRing();
+    ring->enable();
+    const uint64_t count = 200000;
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        uint64_t reads = 0;
+        uint64_t bytes = 0;
+        uint32_t errors = 0;
+        const void * data = nullptr;
+        std::size_t size = 0;
+        while (ring->read(data, size) == asyncpp::result_code::SUCCEED) {
+            //records are checked in place, the first word is the sequence
+            const uint8_t * p = static_cast<const uint8_t *>(data);
+            uint64_t seq = 0;
+            memcpy(&seq, p, sizeof(seq));
+            if (seq != reads || size != message_size(seq) || p[size - 1] != (uint8_t)seq) {
+                ++errors;
+            }
+            ring->release();
+            ++reads;
+            bytes += size;
+        }
+        printf("child: %lu records, %lu bytes, %u errors\n", reads, bytes, errors);
+        fflush(stdout);
+        munmap(ptr, sizeof(MessageRing));
+        close(fd);
+        _exit(0);
+    } else if (pid > 0) {
+        auto t0 = std::chrono::steady_clock::now();
+        for (uint64_t seq = 0; seq < count; ++seq) {
+            std::size_t size = message_size(seq);
+            void * buf = nullptr;
+            //the record is written straight into shared memory
+            if (ring->reserve(size, buf) != asyncpp::result_code::SUCCEED) {
+                break;
+            }
+            uint8_t * p = static_cast<uint8_t *>(buf);
+            memcpy(p, &seq, sizeof(seq));
+            p[size - 1] = (uint8_t)seq;
+            ring->commit(size);
+        }
+        ring->disable();
+        waitpid(pid, NULL, 0);
+        auto t1 = std::chrono::steady_clock::now();
+        printf("parent: %lu records in %ldms through a %lu KB ring\n", count,
+            (long)std::chrono::duration_cast<std::chrono::milliseconds>(t1 - t0).count(),
+            sizeof(MessageRing) / 1024);
+    } else {
+        printf("fork failed\n");
+    }
+    munmap(ptr, sizeof(MessageRing));
+    close(fd);
+    shm_unlink("test_shared_ring");
+}
+
+static void segment_with(const char * name, asyncpp::shm_pages pages)
+{
+    asyncpp::shm_options options;
+    options.pages = pages;
+    options.prefault = true;
+    options.layout_version = 1;
+    asyncpp::shm_segment segment;
+    asyncpp::result_code res = segment.create("test_segment", 4 << 20, options);
+    if (res != asyncpp::result_code::SUCCEED) {
+        printf("%s: create res=%d\n", name, res);
+        return;
+    }
+    MessageRing * ring = nullptr;
+    segment.construct("ring", ring);
+    ring->enable();
+    const uint64_t count = 100000;
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        //a fresh mapping, as an unrelated process would get
+        segment.close();
+        asyncpp::shm_options other = options;
+        other.layout_version = 2;
+        asyncpp::shm_segment attached;
+        asyncpp::result_code mismatch = attached.attach("test_segment", other);
+        res = attached.attach("test_segment", options);
+        uint64_t * wrong = nullptr;
+        asyncpp::result_code wrong_type = attached.find("ring", wrong);
+        MessageRing * r = nullptr;
+        if (res != asyncpp::result_code::SUCCEED || attached.find("ring", r) != asyncpp::result_code::SUCCEED) {
+            printf("%s child: attach res=%d\n", name, res);
+            _exit(1);
+        }
+        uint64_t reads = 0;
+        uint32_t errors = 0;
+        const void * data = nullptr;
+        std::size_t size = 0;
+        while (r->read(data, size) == asyncpp::result_code::SUCCEED) {
+            uint64_t seq = 0;
+            memcpy(&seq, data, sizeof(seq));
+            if (seq != reads || size != message_size(seq)) {
+                ++errors;
+            }
+            r->release();
+            ++reads;
+        }
+        printf("%s child: version mismatch res=%d, wrong type res=%d, %lu records, %u errors\n",
+            name, mismatch, wrong_type, reads, errors);
+        fflush(stdout);
+        _exit(0);
+    } else if (pid > 0) {
+        auto t0 = std::chrono::steady_clock::now();
+        for (uint64_t seq = 0; seq < count; ++seq) {
+            std::size_t size = message_size(seq);
+            void * buf = nullptr;
+            if (ring->reserve(size, buf) != asyncpp::result_code::SUCCEED) {
+                break;
+            }
+            memcpy(buf, &seq, sizeof(seq));
+            ring->commit(size);
+        }
+        ring->disable();
+        waitpid(pid, NULL, 0);
+        auto t1 = std::chrono::steady_clock::now();
+        printf("%s parent: %lu records in %ldms, %lu KB free of %lu KB\n", name, count,
+            (long)std::chrono::duration_cast<std::chrono::milliseconds>(t1 - t0).count(),
+            segment.get_free() / 1024, segment.get_size() / 1024);
+    } else {
+        printf("fork failed\n");
+    }
+    segment.close();
+    asyncpp::shm_segment::remove("test_segment", options);
+}
+
+void test_inter_proc_segment()
+{
+    segment_with("normal pages", asyncpp::SHM_PAGES_NORMAL);
+    segment_with("transparent huge pages", asyncpp::SHM_PAGES_TRANSPARENT);
+    segment_with("hugetlbfs", asyncpp::SHM_PAGES_HUGETLB);
+}
+
+struct Message
+{
+    uint64_t seq;
+    char payload[248];
+};
+
+using MessagePool = asyncpp::object_pool<Message, 512, true>;
+//indices of pooled messages, the payloads never leave the pool
+using IndexQueue = asyncpp::adv_queue<uint32_t, true, asyncpp::flat_ring_queue<uint32_t, 129>>;
+
+void test_inter_proc_pool()
+{
+    asyncpp::shm_segment segment;
+    asyncpp::result_code res = segment.create("test_pool", 1 << 20);
+    if (res != asyncpp::result_code::SUCCEED) {
+        printf("create res=%d\n", res);
+        return;
+    }
+    MessagePool * pool = nullptr;
+    IndexQueue * queue = nullptr;
+    segment.construct("pool", pool);
+    segment.construct("queue", queue);
+    queue->enable(128);
+    const uint64_t count = 200000;
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        uint64_t reads = 0;
+        uint32_t errors = 0;
+        uint32_t index = 0;
+        while (queue->pop(index) == asyncpp::result_code::SUCCEED) {
+            Message & m = pool->get(index);
+            if (m.seq != reads || m.payload[m.seq % sizeof(m.payload)] != (char)m.seq) {
+                ++errors;
+            }
+            //sent home to the parent's cache in batches
+            pool->release(index);
+            ++reads;
+        }
+        pool->flush();
+        printf("child: %lu messages, %u errors\n", reads, errors);
+        fflush(stdout);
+        _exit(0);
+    } else if (pid > 0) {
+        auto t0 = std::chrono::steady_clock::now();
+        uint32_t misses = 0;
+        for (uint64_t seq = 0; seq < count; ++seq) {
+            uint32_t index = 0;
+            while (pool->acquire(index) != asyncpp::result_code::SUCCEED) {
+                ++misses;
+                std::this_thread::yield();
+            }
+            Message & m = pool->get(index);
+            m.seq = seq;
+            m.payload[seq % sizeof(m.payload)] = (char)seq;
+            queue->push(index);
+        }
+        queue->drain();
+        queue->disable();
+        waitpid(pid, NULL, 0);
+        auto t1 = std::chrono::steady_clock::now();
+        uint32_t back = 0;
+        uint32_t index = 0;
+        while (back < MessagePool::get_capacity() && pool->acquire(index) == asyncpp::result_code::SUCCEED) {
+            ++back;
+        }
+        printf("parent: %lu messages in %ldms, %u misses, %u of %u back\n", count,
+            (long)std::chrono::duration_cast<std::chrono::milliseconds>(t1 - t0).count(),
+            misses, back, MessagePool::get_capacity());
+    } else {
+        printf("fork failed\n");
+    }
+    segment.close();
+    asyncpp::shm_segment::remove("test_pool");
+}
@@ -1,8 +1,11 @@
 #include <cstdio>
+#include <sys/resource.h>
 #include <thread>
 #include <atomic>
 #include <vector>
 #include <array>
+#include <algorithm>
+#include <cmath>
 
 #include <asyncpp/adv_semaphore.hpp>
 #include <asyncpp/adv_queue.hpp>
@@ -10,7 +13,26 @@
 #include <asyncpp/basic_queue.hpp>
 #include <asyncpp/sync_queue.hpp>
 #include <asyncpp/barrier.hpp>
+#include <asyncpp/multicast_ring.hpp>
+#include <asyncpp/byte_ring.hpp>
+#include <asyncpp/select.hpp>
 #include <asyncpp/pthread_wrapper.hpp>
+#include <asyncpp/realtime.hpp>
+#include <asyncpp/sojourn.hpp>
+#include <asyncpp/capacity_controller.hpp>
+#include <asyncpp/pipeline.hpp>
+#include <asyncpp/future.hpp>
+#include <asyncpp/parallel.hpp>
+#include <asyncpp/flat_ring_queue.hpp>
+#include <asyncpp/locks.hpp>
+#include <asyncpp/event_count.hpp>
+#include <asyncpp/async_file_io.hpp>
+#include <asyncpp/numa.hpp>
+#include <asyncpp/conflating_queue.hpp>
+#include <asyncpp/dispatcher.hpp>
+#include <asyncpp/object_pool.hpp>
+#include <fcntl.h>
+#include <unistd.h>
 #include <atomic>
 
 
@@ -122,6 +144,1473 @@ void test_queue(int pc, int cc) {
 
 }
 
+void test_multicast_ring(int cc) {
+    const uint32_t total = 100000;
+    {
+        asyncpp::multicast_ring<uint32_t, 1024> ring;
+        std::vector<std::size_t> ids(cc);
+        for (int k = 0; k < cc; ++k) {
+            //the last consumer runs behind all the others
+            if (k == cc - 1 && k > 0) {
+                ring.add_consumer(ids[k], {ids[0]});
+            } else {
+                ring.add_consumer(ids[k]);
+            }
+        }
+        ring.enable();
+        std::atomic<uint32_t> violations = 0;
+        auto t0 = std::chrono::steady_clock::now();
+        auto consumer_proc = [&](int n) {
+            uint64_t sum = 0;
+            uint32_t expected = 0;
+            while (true) {
+                auto res = ring.consume_batch(ids[n], [&](const uint32_t & value) {
+                    if (value != expected) {
+                        ++violations;
+                    }
+                    ++expected;
+                    sum += value;
+                }, 64);
+                if (res != asyncpp::result_code::SUCCEED) {
+                    break;
+                }
+                if (n == cc - 1 && n > 0 && ring.get_sequence(ids[n]) > ring.get_sequence(ids[0])) {
+                    ++violations;
+                }
+            }
+            if (expected != total) {
+                ++violations;
+            }
+        };
+        std::vector<std::thread> consumers;
+        for (int k = 0; k < cc; ++k) {
+            consumers.emplace_back(consumer_proc, k);
+        }
+        for (uint32_t i = 0; i < total; ++i) {
+            ring.publish(i);
+        }
+        ring.drain();
+        ring.disable();
+        for (auto & c : consumers) {
+            c.join();
+        }
+        auto d = std::chrono::steady_clock::now() - t0;
+        printf("multicast_ring cc=%d cost=%ldms violations=%u\n", cc,
+            std::chrono::duration_cast<std::chrono::milliseconds>(d).count(),
+            violations.load()
+        );
+    }
+    {
+        std::vector<asyncpp::adv_queue<uint32_t>> queues(cc);
+        for (auto & q : queues) {
+            q.enable(1024);
+        }
+        auto t0 = std::chrono::steady_clock::now();
+        auto consumer_proc = [&](int n) {
+            uint32_t value = 0;
+            while (queues[n].pop(value) == asyncpp::result_code::SUCCEED) {
+            }
+        };
+        std::vector<std::thread> consumers;
+        for (int k = 0; k < cc; ++k) {
+            consumers.emplace_back(consumer_proc, k);
+        }
+        for (uint32_t i = 0; i < total; ++i) {
+            for (auto & q : queues) {
+                q.push(i);
+            }
+        }
+        for (auto & q : queues) {
+            q.drain();
+            q.disable();
+        }
+        for (auto & c : consumers) {
+            c.join();
+        }
+        auto d = std::chrono::steady_clock::now() - t0;
+        printf("%d adv_queues cost=%ldms\n", cc,
+            std::chrono::duration_cast<std::chrono::milliseconds>(d).count()
+        );
+    }
+}
+
+void test_select() {
+    asyncpp::adv_queue<int> q0;
+    asyncpp::adv_queue<int> q1;
+    asyncpp::basic_queue<int> q2;
+    asyncpp::adv_semaphore<> sem;
+    q0.enable(10);
+    q1.enable(10);
+    q2.enable(10);
+    sem.set_value(0);
+    sem.enable();
+    auto producer = std::thread([&]() {
+        for (int i = 0; i < 30; ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            switch (i % 4) {
+                case 0: q0.push(i); break;
+                case 1: q1.push(i); break;
+                case 2: q2.push(i); break;
+                default: sem.release(); break;
+            }
+        }
+    });
+    asyncpp::selector selector(asyncpp::select_policy::ROUND_ROBIN);
+    int received = 0;
+    while (received < 30) {
+        std::size_t index = 0;
+        auto res = selector.wait_any(index, std::chrono::seconds(1), q0, q1, q2, sem);
+        if (res != asyncpp::result_code::SUCCEED) {
+            printf("select res=%d\n", res);
+            break;
+        }
+        int value = -1;
+        switch (index) {
+            case 0: res = q0.try_pop(value); break;
+            case 1: res = q1.try_pop(value); break;
+            case 2: res = q2.try_pop(value); break;
+            default: res = sem.try_acquire(); break;
+        }
+        if (res == asyncpp::result_code::SUCCEED) {
+            printf("select: %zu fired %d\n", index, value);
+            ++received;
+        }
+    }
+    producer.join();
+    std::size_t index = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    auto res = asyncpp::wait_any(index, std::chrono::milliseconds(200), q0, q1);
+    auto dur = std::chrono::steady_clock::now() - t0;
+    printf("idle select res=%d dur=%ldms\n", res,
+        std::chrono::duration_cast<std::chrono::milliseconds>(dur).count());
+    q1.disable();
+    res = asyncpp::wait_any(index, asyncpp::timeout(), q0, q1);
+    printf("disabled select res=%d index=%zu\n", res, index);
+    q0.disable();
+    q2.disable();
+    sem.disable();
+}
+
+template<bool _InterProcess>
+void test_thundering_herd_with(int tc) {
+    const int rounds = 100;
+    asyncpp::adv_semaphore<_InterProcess> sem;
+    sem.set_value(0);
+    sem.enable();
+    std::atomic<int> taken = 0;
+    std::vector<std::thread> threads;
+    for (int k = 0; k < tc; ++k) {
+        threads.emplace_back([&]() {
+            for (int i = 0; i < rounds; ++i) {
+                if (sem.acquire() != asyncpp::result_code::SUCCEED) {
+                    break;
+                }
+                taken.fetch_add(1);
+            }
+        });
+    }
+    //let everybody block first
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    rusage ru0;
+    getrusage(RUSAGE_SELF, &ru0);
+    auto t0 = std::chrono::steady_clock::now();
+    //one permit at a time, each finds the others parked
+    for (int i = 0; i < tc * rounds; ++i) {
+        sem.release();
+        while (taken.load() <= i) {
+            std::this_thread::yield();
+        }
+    }
+    for (auto & t : threads) {
+        t.join();
+    }
+    auto d = std::chrono::steady_clock::now() - t0;
+    rusage ru1;
+    getrusage(RUSAGE_SELF, &ru1);
+    //wake ups counted by the semaphore itself, the context switches
+    //include the releaser's and depend on how many cpus there are
+    printf("%s tc=%d cost=%ldms wakeups/release=%.2f context switches=%ld\n",
+        _InterProcess ? "notify_all" : "handoff", tc,
+        std::chrono::duration_cast<std::chrono::milliseconds>(d).count(),
+        (double)sem.get_wakeups() / (tc * rounds),
+        (ru1.ru_nvcsw + ru1.ru_nivcsw) - (ru0.ru_nvcsw + ru0.ru_nivcsw)
+    );
+    sem.disable();
+}
+
+//the semaphore as a lock: every thread acquires, works a little and
+//releases again right away. a strict handoff sends the releaser to sleep
+//behind the waiter it just granted, first fit lets it take the permit back
+void test_lock_convoy_with(const char * name, typename asyncpp::adv_semaphore<>::fairness f, int tc) {
+    const int rounds = 20000;
+    asyncpp::adv_semaphore<> sem;
+    sem.set_value(1);
+    sem.set_fairness(f);
+    sem.enable();
+    std::atomic<uint64_t> work = 0;
+    rusage ru0;
+    getrusage(RUSAGE_SELF, &ru0);
+    auto t0 = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int k = 0; k < tc; ++k) {
+        threads.emplace_back([&]() {
+            for (int i = 0; i < rounds; ++i) {
+                sem.acquire();
+                work.fetch_add(1, std::memory_order_relaxed);
+                //lets the others queue up even on a single cpu
+                if (i % 16 == 0) {
+                    std::this_thread::yield();
+                }
+                sem.release();
+            }
+        });
+    }
+    for (auto & t : threads) {
+        t.join();
+    }
+    auto d = std::chrono::steady_clock::now() - t0;
+    rusage ru1;
+    getrusage(RUSAGE_SELF, &ru1);
+    printf("%s convoy tc=%d cost=%ldms wakeups/acquire=%.3f context switches=%ld\n",
+        name, tc, std::chrono::duration_cast<std::chrono::milliseconds>(d).count(),
+        (double)sem.get_wakeups() / work.load(),
+        (ru1.ru_nvcsw + ru1.ru_nivcsw) - (ru0.ru_nvcsw + ru0.ru_nivcsw)
+    );
+    sem.disable();
+}
+
+void test_thundering_herd(int tc) {
+    //the process shared flavour still wakes every waiter on each release
+    test_thundering_herd_with<true>(tc);
+    test_thundering_herd_with<false>(tc);
+    test_lock_convoy_with("strict", asyncpp::adv_semaphore<>::STRICT, 4);
+    test_lock_convoy_with("first fit", asyncpp::adv_semaphore<>::FIRST_FIT, 4);
+}
+
+void test_block_behind_value_waiter() {
+    //a value waiter that can't be served must not hold back a block
+    //waiter queued behind it once the block is free
+    asyncpp::adv_semaphore<> sem;
+    sem.set_value(0);
+    sem.enable();
+    sem.block();
+    std::thread value_waiter([&]() {
+        printf("value waiter: %d\n", sem.acquire());
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    asyncpp::result_code blocked = asyncpp::result_code::SUCCEED;
+    long waited = 0;
+    std::thread block_waiter([&]() {
+        auto t0 = std::chrono::steady_clock::now();
+        blocked = sem.block(nullptr, asyncpp::timeout(std::chrono::seconds(2)));
+        waited = (long)std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - t0).count();
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        sem.unblock();
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    sem.unblock();
+    block_waiter.join();
+    printf("block waiter: %d after %ldms\n", blocked, waited);
+    sem.release();
+    value_waiter.join();
+}
+
+void test_sojourn() {
+    asyncpp::adv_queue<int, false, std::list<asyncpp::stamped<int>>> queue;
+    asyncpp::basic_queue<int, false, asyncpp::flat_ring_queue<asyncpp::stamped<int>, 101>> fast;
+    queue.enable(100);
+    fast.enable(100);
+    auto consumer_proc = [&](asyncpp::latency_histogram & local) {
+        int value = 0;
+        while (queue.pop(value) == asyncpp::result_code::SUCCEED) {
+            //a slow consumer every few items
+            if (value % 10 == 0) {
+                std::this_thread::sleep_for(std::chrono::microseconds(500));
+            }
+            auto t0 = asyncpp::clock::now();
+            fast.push(value);
+            fast.pop(value);
+            local.record((asyncpp::clock::now() - t0).count());
+        }
+    };
+    asyncpp::latency_histogram h0;
+    asyncpp::latency_histogram h1;
+    auto c0 = std::thread(consumer_proc, std::ref(h0));
+    auto c1 = std::thread(consumer_proc, std::ref(h1));
+    for (int i = 0; i < 5000; ++i) {
+        queue.push(i);
+    }
+    queue.drain();
+    queue.disable();
+    c0.join();
+    c1.join();
+    fast.disable();
+    auto & h = queue.get_sojourn();
+    printf("sojourn: count=%lu p50=%luus p99=%luus p99.9=%luus max=%luus\n",
+        h.get_count(), h.p50() / 1000, h.p99() / 1000, h.p999() / 1000, h.get_max() / 1000);
+    auto & f = fast.get_sojourn();
+    printf("push+pop sojourn: count=%lu p50=%luns p99=%luns max=%luns\n",
+        f.get_count(), f.p50(), f.p99(), f.get_max());
+    h0.merge(h1);
+    printf("merged push+pop cost: count=%lu p50=%luns p99=%luns\n",
+        h0.get_count(), h0.p50(), h0.p99());
+}
+
+void test_codel_with(const char * name, bool aqm, asyncpp::aqm_mode mode) {
+    using queue_t = asyncpp::adv_queue<int, false, std::list<asyncpp::stamped<int>>>;
+    queue_t queue;
+    std::atomic<uint32_t> dropped = 0;
+    std::atomic<uint32_t> rejected = 0;
+    if (aqm) {
+        queue.enable_aqm(mode, std::chrono::milliseconds(5), std::chrono::milliseconds(100),
+            [&](int &&) { ++dropped; });
+    }
+    queue.enable(1000);
+    //the producer starts at about twice what the consumer can serve
+    auto consumer = std::thread([&]() {
+        int value = 0;
+        while (queue.pop(value) == asyncpp::result_code::SUCCEED) {
+            auto until = asyncpp::clock::now() + std::chrono::microseconds(200);
+            while (asyncpp::clock::now() < until) {
+            }
+        }
+    });
+    //the producer backs off on congestion signals like a tcp sender
+    double gap = 100;
+    uint32_t signals = 0;
+    auto t0 = asyncpp::clock::now();
+    for (int i = 0; asyncpp::clock::now() - t0 < std::chrono::milliseconds(3000); ++i) {
+        if (queue.push(i) == asyncpp::result_code::REJECTED) {
+            ++rejected;
+        }
+        if (dropped + rejected != signals) {
+            signals = dropped + rejected;
+            gap *= 2;
+        } else if (gap > 100) {
+            gap -= 0.2;
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds((int64_t)gap));
+    }
+    queue.disable();
+    consumer.join();
+    auto & h = queue.get_sojourn();
+    printf("%s: delivered=%lu dropped=%u rejected=%u p50=%lums p99=%lums max=%lums\n", name,
+        h.get_count() - dropped, dropped.load(), rejected.load(),
+        h.p50() / 1000000, h.p99() / 1000000, h.get_max() / 1000000);
+}
+
+void test_codel() {
+    test_codel_with("no aqm", false, asyncpp::aqm_mode::AQM_DROP_HEAD);
+    test_codel_with("codel drop head", true, asyncpp::aqm_mode::AQM_DROP_HEAD);
+    test_codel_with("codel reject push", true, asyncpp::aqm_mode::AQM_REJECT_PUSH);
+}
+
+void test_capacity_controller_with(const char * name, asyncpp::capacity_policy policy) {
+    using queue_t = asyncpp::adv_queue<int>;
+    queue_t queue;
+    queue.enable(16);
+    asyncpp::capacity_controller<queue_t> controller(queue);
+    controller.configure(16, 4096, policy);
+    controller.set_aimd(64, 0.5);
+    controller.set_target_wait(std::chrono::milliseconds(50));
+    uint64_t lo = UINT64_MAX;
+    uint64_t hi = 0;
+    uint32_t failed = 0;
+    uint32_t changes = 0;
+    controller.on_decision([&](const asyncpp::capacity_decision & d) {
+        lo = std::min(lo, d.new_capacity);
+        hi = std::max(hi, d.new_capacity);
+        if (d.applied != asyncpp::result_code::SUCCEED) {
+            ++failed;
+        }
+        if (d.new_capacity != d.old_capacity && ++changes % 8 == 1) {
+            printf("%s: size=%lu blocked=%.2f idle=%.2f rate=%.0f/s capacity %lu -> %lu\n", name,
+                (unsigned long)d.size, d.producer_blocked, d.consumer_idle, d.throughput,
+                (unsigned long)d.old_capacity, (unsigned long)d.new_capacity);
+        }
+    });
+    //the consumer serves about 10k items per second
+    auto consumer = std::thread([&]() {
+        int value = 0;
+        while (queue.pop(value) == asyncpp::result_code::SUCCEED) {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+    });
+    controller.start(std::chrono::milliseconds(20));
+    //bursts of 3000 items as fast as possible, then silence
+    for (int burst = 0; burst < 4; ++burst) {
+        for (int i = 0; i < 3000; ++i) {
+            queue.push(i);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(600));
+    }
+    controller.stop();
+    queue.disable();
+    consumer.join();
+    printf("%s: capacity within [%lu, %lu], changes=%u, failed=%u, final=%lu\n", name,
+        (unsigned long)lo, (unsigned long)hi, changes, failed, (unsigned long)queue.get_capacity());
+}
+
+void test_capacity_controller() {
+    test_capacity_controller_with("aimd", asyncpp::capacity_policy::CAPACITY_AIMD);
+    test_capacity_controller_with("target wait", asyncpp::capacity_policy::CAPACITY_TARGET_WAIT);
+    //byte budgets past 4GB are kept as they are by an idle queue
+    using queue_t = asyncpp::adv_queue<std::vector<char>>;
+    queue_t queue;
+    queue.enable_bytes(10ull << 30);
+    asyncpp::capacity_controller<queue_t> controller(queue);
+    controller.configure(1ull << 30, 16ull << 30, asyncpp::capacity_policy::CAPACITY_AIMD);
+    controller.sample();
+    asyncpp::capacity_decision d = controller.sample();
+    printf("10GB queue: capacity %lu -> %lu, now=%lu\n", (unsigned long)d.old_capacity,
+        (unsigned long)d.new_capacity, (unsigned long)queue.get_capacity());
+    queue.disable();
+}
+
+void test_shrink_keeps_block() {
+    asyncpp::adv_queue<int> queue;
+    queue.enable(8);
+    for (int i = 0; i < 8; ++i) {
+        queue.push(i);
+    }
+    auto try_push = [&]() {
+        asyncpp::result_code res = asyncpp::result_code::SUCCEED;
+        std::thread([&]() { res = queue.try_push(100); }).join();
+        return res;
+    };
+    //a shrink timing out behind someone else's block leaves it alone
+    queue.block_pushing();
+    asyncpp::result_code res = asyncpp::result_code::SUCCEED;
+    std::thread([&]() {
+        res = queue.change_capacity(4, std::chrono::milliseconds(20));
+    }).join();
+    printf("shrink behind block: %d, try_push: %d\n", res, try_push());
+    queue.unblock_pushing();
+    //a shrink timing out on a full queue gives back the block it took
+    res = queue.change_capacity(4, std::chrono::milliseconds(20));
+    int value = 0;
+    queue.pop(value);
+    printf("shrink on full queue: %d, try_push: %d, capacity: %lu\n",
+        res, try_push(), (unsigned long)queue.get_capacity());
+    queue.disable();
+}
+
+void test_pipeline() {
+    const int count = 200000;
+    std::atomic<uint64_t> sum = 0;
+    int next = 0;
+    auto spin = [](int us) {
+        auto until = asyncpp::clock::now() + std::chrono::microseconds(us);
+        while (asyncpp::clock::now() < until) {
+        }
+    };
+    auto p = asyncpp::source<int>([&](int & item) {
+            item = next++;
+            return item < count;
+        })
+        | asyncpp::stage([&](int && v) {
+            if (v % 1000 == 0) {
+                spin(100);
+            }
+            return (uint64_t)v * 2;
+        }, 4, 4096, "double")
+        | asyncpp::stage([](uint64_t && v) {
+            return v % 3 == 0 ? std::optional<uint64_t>() : std::optional<uint64_t>(v);
+        }, 1, 1024, "filter")
+        | asyncpp::stage([](uint64_t && v) { return std::to_string(v); }, 1, 1024, "format")
+        | asyncpp::sink([&](std::string && s) { sum += std::stoull(s); });
+    p.run();
+    uint64_t expected = 0;
+    for (int i = 0; i < count; ++i) {
+        if ((uint64_t)i * 2 % 3 != 0) {
+            expected += (uint64_t)i * 2;
+        }
+    }
+    printf("pipeline: sum=%lu expected=%lu %s\n", sum.load(), expected, sum == expected ? "ok" : "WRONG");
+    auto stats = p.get_stats();
+    for (std::size_t k = 0; k < stats.size(); ++k) {
+        printf("  %-8s x%u fused=%d items=%lu busy=%ldms rate=%.0f/s util=%.2f\n",
+            stats[k].name.c_str(), stats[k].parallelism, (int)p.is_fused(k), stats[k].items,
+            (long)std::chrono::duration_cast<std::chrono::milliseconds>(stats[k].busy).count(),
+            stats[k].throughput, stats[k].utilization);
+    }
+    printf("  bottleneck: %s\n", stats[p.get_bottleneck()].name.c_str());
+
+    //stopping early still delivers everything the source produced
+    std::atomic<uint64_t> produced = 0;
+    std::atomic<uint64_t> delivered = 0;
+    auto q = asyncpp::source<int>([&](int & item) {
+            item = 1;
+            ++produced;
+            return true;
+        })
+        | asyncpp::stage([](int && v) { return v; }, 2, 256)
+        | asyncpp::sink([&](int &&) { ++delivered; });
+    q.start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    q.stop();
+    q.wait();
+    printf("pipeline stop: produced=%lu delivered=%lu %s\n", produced.load(), delivered.load(),
+        produced == delivered ? "ok" : "WRONG");
+}
+
+void test_future() {
+    using namespace std::chrono;
+    //continuations, inline and on another thread
+    {
+        asyncpp::promise<int> p;
+        auto f = p.get_future()
+            .then([](int && v) { return v + 1; })
+            .then([](int && v) { return std::to_string(v * 2); });
+        auto t = std::thread([&]() { p.set_value(20); });
+        std::string s;
+        auto res = f.get(s);
+        t.join();
+        printf("future then: res=%d value=%s %s\n", res, s.c_str(), s == "42" ? "ok" : "WRONG");
+    }
+    //a dropped promise breaks the whole chain
+    {
+        asyncpp::future<int> f;
+        {
+            asyncpp::promise<int> p;
+            f = p.get_future().then([](int && v) { return v; });
+        }
+        int v = 0;
+        printf("future broken: %s\n", f.get(v) == asyncpp::result_code::DISABLED ? "ok" : "WRONG");
+    }
+    //timeouts
+    {
+        asyncpp::promise<int> p;
+        auto f = p.get_future();
+        int v = 0;
+        auto res = f.get(v, milliseconds(20));
+        p.set_value(7);
+        auto res2 = f.get(v);
+        printf("future timeout: %s\n",
+            res == asyncpp::result_code::UNAVAILABLE_OR_TIMEOUT && res2 == asyncpp::result_code::SUCCEED && v == 7
+                ? "ok" : "WRONG");
+    }
+    //combinators
+    {
+        std::vector<asyncpp::promise<int>> ps(8);
+        std::vector<asyncpp::future<int>> all;
+        std::vector<asyncpp::future<int>> any;
+        for (int i = 0; i < 4; ++i) {
+            all.emplace_back(ps[i].get_future());
+            any.emplace_back(ps[4 + i].get_future());
+        }
+        auto fall = asyncpp::when_all(std::move(all));
+        auto fany = asyncpp::when_any(std::move(any));
+        ps[6].set_value(60);
+        ps[5].set_value(50);
+        for (int i = 3; i >= 0; --i) {
+            ps[i].set_value(i);
+        }
+        std::vector<int> values;
+        std::pair<std::size_t, int> first;
+        fall.get(values);
+        fany.get(first);
+        printf("when_all: %d %d %d %d, when_any: [%lu]=%d %s\n", values[0], values[1], values[2], values[3],
+            first.first, first.second, first.first == 2 && first.second == 60 ? "ok" : "WRONG");
+    }
+    //request/response round trips against a thread
+    const int rounds = 100000;
+    {
+        asyncpp::sync_queue<asyncpp::promise<int> *> requests;
+        requests.enable();
+        auto server = std::thread([&]() {
+            asyncpp::promise<int> * p = nullptr;
+            for (int i = 0; i < rounds; ++i) {
+                requests.pop(p);
+                p->set_value(i);
+            }
+        });
+        auto t0 = steady_clock::now();
+        for (int i = 0; i < rounds; ++i) {
+            asyncpp::promise<int> p;
+            auto f = p.get_future();
+            requests.push(&p);
+            int v = 0;
+            f.get(v);
+        }
+        auto t1 = steady_clock::now();
+        server.join();
+        printf("future round trip: %ldns\n", (long)duration_cast<nanoseconds>(t1 - t0).count() / rounds);
+    }
+    {
+        asyncpp::sync_queue<int> requests;
+        asyncpp::adv_queue<int> reply;
+        requests.enable();
+        reply.enable(1);
+        auto server = std::thread([&]() {
+            int v = 0;
+            for (int i = 0; i < rounds; ++i) {
+                requests.pop(v);
+                reply.push(v);
+            }
+        });
+        auto t0 = steady_clock::now();
+        for (int i = 0; i < rounds; ++i) {
+            int v = i;
+            requests.push(v);
+            reply.pop(v);
+        }
+        auto t1 = steady_clock::now();
+        server.join();
+        printf("adv_queue round trip: %ldns\n", (long)duration_cast<nanoseconds>(t1 - t0).count() / rounds);
+    }
+}
+
+void test_parallel_for(uint32_t tc) {
+    using namespace std::chrono;
+    const std::size_t n = 1 << 20;
+    const int jobs = 50;
+    std::vector<float> in(n);
+    std::vector<float> out(n);
+    for (std::size_t i = 0; i < n; ++i) {
+        in[i] = (float)i;
+    }
+    //the cost of an element grows along the range, static partitions are unbalanced
+    auto work = [&](std::size_t i) {
+        float v = in[i];
+        for (std::size_t k = 0; k < 1 + i * 8 / n; ++k) {
+            v = std::sqrt(v + 1.0f);
+        }
+        out[i] = v;
+    };
+    auto run_static = [&](uint32_t t) {
+        for (std::size_t i = n * t / tc; i < n * (t + 1) / tc; ++i) {
+            work(i);
+        }
+    };
+
+    auto t0 = steady_clock::now();
+    for (int j = 0; j < jobs; ++j) {
+        std::vector<std::thread> threads;
+        for (uint32_t t = 0; t < tc; ++t) {
+            threads.emplace_back(run_static, t);
+        }
+        for (auto & thread : threads) {
+            thread.join();
+        }
+    }
+    auto t1 = steady_clock::now();
+
+    asyncpp::barrier<> barrier;
+    barrier.enable(tc + 1);
+    std::vector<std::thread> threads;
+    for (uint32_t t = 0; t < tc; ++t) {
+        threads.emplace_back([&, t]() {
+            while (barrier.await() == asyncpp::SUCCEED) {
+                run_static(t);
+                barrier.await();
+            }
+        });
+    }
+    auto t2 = steady_clock::now();
+    for (int j = 0; j < jobs; ++j) {
+        barrier.await();
+        barrier.await();
+    }
+    auto t3 = steady_clock::now();
+    barrier.disable();
+    for (auto & thread : threads) {
+        thread.join();
+    }
+
+    asyncpp::worker_pool pool(tc > 1 ? tc - 1 : 1);
+    auto t4 = steady_clock::now();
+    for (int j = 0; j < jobs; ++j) {
+        asyncpp::parallel_for(pool, 0, n, 0, work);
+    }
+    auto t5 = steady_clock::now();
+    printf("parallel_for x%u: threads per job %ldus, barrier %ldus, pool %ldus per job\n", tc,
+        (long)duration_cast<microseconds>(t1 - t0).count() / jobs,
+        (long)duration_cast<microseconds>(t3 - t2).count() / jobs,
+        (long)duration_cast<microseconds>(t5 - t4).count() / jobs);
+
+    uint64_t sum = asyncpp::parallel_reduce(pool, 0, n, 0, (uint64_t)0,
+        [](std::size_t i) { return (uint64_t)i; },
+        [](uint64_t a, uint64_t b) { return a + b; });
+    //nested loops run on the same workers
+    std::atomic<uint64_t> nested = 0;
+    asyncpp::parallel_for(pool, 0, 64, 1, [&](std::size_t) {
+        nested += asyncpp::parallel_reduce(pool, 0, 1000, 10, (uint64_t)0,
+            [](std::size_t b, std::size_t e) { return (uint64_t)(e - b); },
+            [](uint64_t a, uint64_t b) { return a + b; });
+    });
+    printf("parallel_reduce: sum=%lu %s, nested=%lu %s\n",
+        sum, sum == (uint64_t)n * (n - 1) / 2 ? "ok" : "WRONG",
+        nested.load(), nested == 64000 ? "ok" : "WRONG");
+}
+
+template<template<bool> typename _Policy>
+void test_lock_policy_with(const char * name, int tc) {
+    const int rounds = 100000;
+    asyncpp::adv_queue<int, false, std::list<int>, _Policy> queue;
+    asyncpp::barrier<uint32_t, false, _Policy> barrier;
+    queue.enable(64);
+    barrier.enable(tc * 2);
+    std::atomic<long> sum = 0;
+    std::vector<std::thread> threads;
+    auto t0 = std::chrono::steady_clock::now();
+    for (int k = 0; k < tc; ++k) {
+        threads.emplace_back([&]() {
+            for (int i = 0; i < rounds; ++i) {
+                queue.push(1);
+            }
+            barrier.await();
+        });
+        threads.emplace_back([&]() {
+            long local = 0;
+            int value = 0;
+            for (int i = 0; i < rounds; ++i) {
+                if (queue.pop(value) == asyncpp::result_code::SUCCEED) {
+                    local += value;
+                }
+            }
+            sum += local;
+            barrier.await();
+        });
+    }
+    for (auto & t : threads) {
+        t.join();
+    }
+    auto d = std::chrono::steady_clock::now() - t0;
+    printf("%s tc=%d sum=%ld expected=%ld cost=%ldms\n", name, tc,
+        sum.load(), (long)tc * rounds,
+        std::chrono::duration_cast<std::chrono::milliseconds>(d).count());
+    queue.disable();
+    barrier.disable();
+}
+
+void test_lock_policies(int tc) {
+    test_lock_policy_with<asyncpp::sync_policy>("mutex", tc);
+    test_lock_policy_with<asyncpp::ticket_policy>("ticket", tc);
+    test_lock_policy_with<asyncpp::mcs_policy>("mcs", tc);
+    test_lock_policy_with<asyncpp::adaptive_policy>("adaptive", tc);
+    test_lock_policy_with<asyncpp::event_policy>("event", tc);
+}
+
+template<bool _InterProcess>
+void test_byte_budget_with(const char * name, typename asyncpp::byte_budget<_InterProcess>::fairness f) {
+    const uint64_t budget = 1 << 20;
+    const auto run_for = std::chrono::milliseconds(500);
+    asyncpp::byte_budget<_InterProcess> sem;
+    sem.set_value(budget);
+    sem.set_fairness(f);
+    sem.enable();
+    std::atomic<uint64_t> used = 0;
+    std::atomic<uint64_t> peak = 0;
+    std::atomic<long> small = 0;
+    std::atomic<long> large = 0;
+    std::atomic<long> worst = 0;
+    auto hold = [&](uint64_t bytes) {
+        uint64_t now = used.fetch_add(bytes) + bytes;
+        uint64_t p = peak.load();
+        while (now > p && !peak.compare_exchange_weak(p, now)) {}
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+        used.fetch_sub(bytes);
+    };
+    auto until = std::chrono::steady_clock::now() + run_for;
+    std::vector<std::thread> threads;
+    for (int k = 0; k < 4; ++k) {
+        threads.emplace_back([&, k]() {
+            uint64_t bytes = 4096 * (k + 1);
+            while (std::chrono::steady_clock::now() < until) {
+                if (sem.acquire(bytes) != asyncpp::result_code::SUCCEED) {
+                    break;
+                }
+                hold(bytes);
+                sem.release(bytes);
+                ++small;
+            }
+        });
+    }
+    threads.emplace_back([&]() {
+        //only fits once nearly every small request is back
+        uint64_t bytes = budget - 8192;
+        while (std::chrono::steady_clock::now() < until) {
+            auto t0 = std::chrono::steady_clock::now();
+            if (sem.acquire(bytes) != asyncpp::result_code::SUCCEED) {
+                break;
+            }
+            long waited = (long)std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - t0).count();
+            if (waited > worst) {
+                worst = waited;
+            }
+            hold(bytes);
+            sem.release(bytes);
+            ++large;
+        }
+    });
+    for (auto & t : threads) {
+        t.join();
+    }
+    printf("%s small=%ld large=%ld worst large wait=%ldus peak=%lu budget=%lu left=%lu\n",
+        name, small.load(), large.load(), worst.load(),
+        (unsigned long)peak.load(), (unsigned long)budget, (unsigned long)sem.get_value());
+    sem.disable();
+}
+
+void test_byte_budget() {
+    test_byte_budget_with<false>("strict", asyncpp::byte_budget<false>::STRICT);
+    test_byte_budget_with<false>("first fit", asyncpp::byte_budget<false>::FIRST_FIT);
+    test_byte_budget_with<true>("shared", asyncpp::byte_budget<true>::STRICT);
+}
+
+void test_byte_queue() {
+    const uint64_t budget = 1 << 20;
+    asyncpp::adv_queue<std::vector<char>> queue;
+    queue.enable_bytes(budget, 64);
+    std::atomic<uint64_t> peak = 0;
+    std::atomic<uint32_t> peak_items = 0;
+    std::atomic<bool> done = false;
+    auto producer = std::thread([&]() {
+        uint32_t seed = 1;
+        for (int i = 0; i < 20000; ++i) {
+            seed = seed * 1103515245 + 12345;
+            //100 bytes to 256KB
+            std::vector<char> item(100 + (seed >> 8) % (256 << 10));
+            if (queue.push(std::move(item)) != asyncpp::result_code::SUCCEED) {
+                break;
+            }
+            uint64_t bytes = queue.get_bytes();
+            uint64_t p = peak.load();
+            while (bytes > p && !peak.compare_exchange_weak(p, bytes)) {}
+            uint32_t items = queue.get_size();
+            uint32_t pi = peak_items.load();
+            while (items > pi && !peak_items.compare_exchange_weak(pi, items)) {}
+        }
+        done = true;
+    });
+    auto consumer = std::thread([&]() {
+        std::vector<char> item;
+        while (queue.pop(item) == asyncpp::result_code::SUCCEED) {
+        }
+    });
+    asyncpp::result_code res = queue.push(std::vector<char>(budget + 1));
+    printf("oversized push res=%d\n", res);
+    while (!done) {
+        res = queue.fill(budget / 2, std::chrono::seconds(1));
+        printf("filled res=%d bytes=%lu items=%u\n", res, (unsigned long)queue.get_bytes(), queue.get_size());
+        res = queue.drain(std::chrono::seconds(1));
+        printf("drained res=%d bytes=%lu\n", res, (unsigned long)queue.get_bytes());
+        queue.unblock_popping();
+        queue.unblock_pushing();
+        res = queue.change_capacity(queue.get_capacity() == budget ? budget / 2 : budget, std::chrono::seconds(1));
+        printf("capacity res=%d now=%lu\n", res, (unsigned long)queue.get_capacity());
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    producer.join();
+    //let the consumer empty the queue
+    queue.drain(std::chrono::seconds(1));
+    queue.disable();
+    consumer.join();
+    printf("peak bytes=%lu budget=%lu peak items=%u\n",
+        (unsigned long)peak.load(), (unsigned long)budget, peak_items.load());
+}
+
+void test_byte_fill_timeout() {
+    asyncpp::adv_queue<std::vector<char>> queue;
+    queue.enable_bytes(1 << 20);
+    queue.push(std::vector<char>(100));
+    //nobody pushes the rest, the fill times out and must not keep poppers out
+    asyncpp::result_code res = queue.fill(1 << 16, std::chrono::milliseconds(20));
+    asyncpp::result_code popped = asyncpp::result_code::SUCCEED;
+    std::size_t size = 0;
+    std::thread([&]() {
+        std::vector<char> item;
+        popped = queue.pop(item, std::chrono::milliseconds(100));
+        size = item.size();
+    }).join();
+    printf("fill: %d, pop: %d size=%zu\n", res, popped, size);
+    //a fill that made it keeps poppers out until drained
+    queue.push(std::vector<char>(1 << 16));
+    res = queue.fill(1 << 16, std::chrono::milliseconds(20));
+    std::thread([&]() {
+        std::vector<char> item;
+        popped = queue.try_pop(item);
+    }).join();
+    printf("fill: %d, try_pop: %d\n", res, popped);
+    queue.disable();
+}
+
+void test_byte_ring_timeout() {
+    asyncpp::byte_ring<1024> ring;
+    ring.enable();
+    uint64_t value = 1;
+    ring.push(&value, sizeof(value));
+    //the first reader and writer hold a record, the second ones must give up
+    const void * data = nullptr;
+    std::size_t size = 0;
+    void * buf = nullptr;
+    ring.read(data, size);
+    ring.reserve(sizeof(value), buf);
+    asyncpp::result_code reader = asyncpp::result_code::SUCCEED;
+    asyncpp::result_code writer = asyncpp::result_code::SUCCEED;
+    auto t0 = std::chrono::steady_clock::now();
+    std::thread([&]() {
+        const void * d = nullptr;
+        std::size_t n = 0;
+        reader = ring.read(d, n, std::chrono::milliseconds(50));
+    }).join();
+    std::thread([&]() {
+        writer = ring.push(&value, sizeof(value), std::chrono::milliseconds(50));
+    }).join();
+    long ms = (long)std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - t0).count();
+    printf("second reader: %d, second writer: %d after %ldms\n", reader, writer, ms);
+    //a timed reader gets its turn once the record is released
+    std::thread second([&]() {
+        const void * d = nullptr;
+        std::size_t n = 0;
+        reader = ring.read(d, n, std::chrono::seconds(1));
+        if (reader == asyncpp::result_code::SUCCEED) {
+            ring.release();
+        }
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    ring.commit(sizeof(value));
+    ring.release();
+    second.join();
+    printf("waiting reader: %d, used: %lu\n", reader, (unsigned long)ring.get_used());
+    ring.disable();
+}
+
+void test_file_io_with(const char * name, bool uring) {
+    const uint32_t block = 4096;
+    const uint32_t blocks = 4096;
+    char path[] = "/tmp/asyncpp_io_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd == -1) {
+        printf("mkstemp failed\n");
+        return;
+    }
+    unlink(path);
+    std::vector<char> data((std::size_t)block * blocks);
+    for (std::size_t i = 0; i < data.size(); ++i) {
+        data[i] = (char)(i * 31 + i / block);
+    }
+    std::vector<char> back(data.size());
+    asyncpp::adv_queue<asyncpp::io_completion> completions;
+    completions.enable(blocks);
+    asyncpp::file_io_options options;
+    options.depth = 64;
+    options.use_uring = uring;
+    asyncpp::async_file_io io;
+    io.start(completions, options);
+    struct iovec iov = {back.data(), back.size()};
+    io.register_buffers(&iov, 1);
+    std::vector<asyncpp::io_request> requests(blocks);
+    auto run = [&](asyncpp::io_op op, char * base, int buf_index) {
+        for (uint32_t i = 0; i < blocks; ++i) {
+            requests[i] = asyncpp::io_request{fd, op, base + (std::size_t)i * block, block,
+                (uint64_t)i * block, i, buf_index};
+        }
+        auto t0 = std::chrono::steady_clock::now();
+        uint32_t submitted = 0;
+        asyncpp::result_code res = io.submit(requests.data(), blocks, submitted);
+        uint32_t failed = 0;
+        asyncpp::io_completion c;
+        for (uint32_t i = 0; i < submitted; ++i) {
+            completions.pop(c);
+            if (c.result != block) {
+                ++failed;
+            }
+        }
+        auto d = std::chrono::steady_clock::now() - t0;
+        return std::make_tuple(res, failed, (long)std::chrono::duration_cast<std::chrono::microseconds>(d).count());
+    };
+    auto [wres, wfailed, wus] = run(asyncpp::IO_WRITE, data.data(), -1);
+    auto [rres, rfailed, rus] = run(asyncpp::IO_READ, back.data(), 0);
+    io.stop();
+    completions.disable();
+    close(fd);
+    printf("%s (uring=%d): write res=%d failed=%u %ldus, fixed read res=%d failed=%u %ldus, data %s\n",
+        name, io.is_uring(), wres, wfailed, wus, rres, rfailed, rus, data == back ? "ok" : "MISMATCH");
+}
+
+void test_file_io() {
+    test_file_io_with("io_uring", true);
+    test_file_io_with("thread pool", false);
+}
+
+template<template<bool> typename _Policy>
+void test_event_policy_with(const char * name) {
+    const int rounds = 50000;
+    asyncpp::adv_semaphore<false, uint32_t, _Policy> ping;
+    asyncpp::basic_semaphore<false, uint32_t, _Policy> pong;
+    ping.set_value(0);
+    ping.enable();
+    pong.set_value(0);
+    pong.enable();
+    auto t0 = std::chrono::steady_clock::now();
+    std::thread peer([&]() {
+        for (int i = 0; i < rounds; ++i) {
+            ping.acquire();
+            pong.release();
+        }
+    });
+    for (int i = 0; i < rounds; ++i) {
+        ping.release();
+        pong.acquire();
+    }
+    peer.join();
+    auto round_trip = std::chrono::steady_clock::now() - t0;
+    //releases nobody waits for
+    t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; ++i) {
+        ping.release();
+    }
+    auto release = std::chrono::steady_clock::now() - t0;
+    printf("%s: round trip %ldns, uncontended release %ldns\n", name,
+        (long)std::chrono::duration_cast<std::chrono::nanoseconds>(round_trip).count() / rounds,
+        (long)std::chrono::duration_cast<std::chrono::nanoseconds>(release).count() / rounds);
+    ping.disable();
+    pong.disable();
+}
+
+void test_event_count() {
+    const int rounds = 1000000;
+    asyncpp::event_count<> ec;
+    asyncpp::blocking_wait<> bw;
+    auto t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; ++i) {
+        ec.notify();
+    }
+    auto d0 = std::chrono::steady_clock::now() - t0;
+    t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; ++i) {
+        bw.notify();
+    }
+    auto d1 = std::chrono::steady_clock::now() - t0;
+    printf("notify with no waiters: event_count %ldns, blocking_wait %ldns\n",
+        (long)std::chrono::duration_cast<std::chrono::nanoseconds>(d0).count() / rounds,
+        (long)std::chrono::duration_cast<std::chrono::nanoseconds>(d1).count() / rounds);
+
+    //a lock free counter with consumers parked on the event count
+    std::atomic<uint32_t> items = 0;
+    std::atomic<uint32_t> taken = 0;
+    std::atomic<bool> done = false;
+    std::vector<std::thread> consumers;
+    for (int k = 0; k < 3; ++k) {
+        consumers.emplace_back([&]() {
+            while (true) {
+                ec.wait([&] {
+                    return items.load() > 0 || done.load();
+                });
+                uint32_t n = items.load();
+                while (n > 0 && !items.compare_exchange_weak(n, n - 1)) {}
+                if (n > 0) {
+                    ++taken;
+                } else if (done.load()) {
+                    break;
+                }
+            }
+        });
+    }
+    for (int i = 0; i < 100000; ++i) {
+        items.fetch_add(1);
+        ec.notify_one();
+    }
+    while (items.load() > 0) {
+        std::this_thread::yield();
+    }
+    done = true;
+    ec.notify_all();
+    for (auto & t : consumers) {
+        t.join();
+    }
+    printf("event_count consumers took %u of 100000\n", taken.load());
+
+    test_event_policy_with<asyncpp::sync_policy>("condvar");
+    test_event_policy_with<asyncpp::event_policy>("event_count");
+}
+
+template<typename _Queue>
+double numa_round_trip(_Queue & queue, int items) {
+    auto t0 = std::chrono::steady_clock::now();
+    std::thread consumer([&]() {
+        int value = 0;
+        for (int i = 0; i < items; ++i) {
+            queue.pop(value);
+        }
+    });
+    for (int i = 0; i < items; ++i) {
+        queue.push(i);
+    }
+    consumer.join();
+    auto d = std::chrono::steady_clock::now() - t0;
+    return items / std::chrono::duration<double>(d).count();
+}
+
+void test_numa() {
+    using ring_queue = asyncpp::adv_queue<int, false, asyncpp::flat_ring_queue<int, 4097>>;
+    const int items = 1000000;
+    int nodes = asyncpp::numa::node_count();
+    int home = asyncpp::numa::current_node();
+    int remote = (home + 1) % nodes;
+    printf("numa: %d nodes, running on node %d\n", nodes, home);
+    if (nodes == 1) {
+        printf("numa: single node, local and remote are the same memory\n");
+    }
+    asyncpp::numa::run_on_node(home);
+
+    asyncpp::numa_placed<ring_queue> local;
+    asyncpp::numa_placed<ring_queue> far;
+    printf("place local: %d, remote: %d\n", local.create(home), far.create(remote));
+    local->enable(4096);
+    far->enable(4096);
+    printf("local ring on node %d: %.0f items/s\n",
+        asyncpp::numa::node_of(local.get()), numa_round_trip(*local, items));
+    printf("remote ring on node %d: %.0f items/s\n",
+        asyncpp::numa::node_of(far.get()), numa_round_trip(*far, items));
+    //follows the consumer once it is known
+    printf("move to consumer's node: %d\n", far.move_to(asyncpp::numa::current_node()));
+
+    //producers on every node, each pushing to its own node's shard
+    asyncpp::numa_sharded<ring_queue, int> sharded;
+    sharded.enable(4096);
+    std::atomic<int> popped = 0;
+    std::atomic<long> sum = 0;
+    std::vector<std::thread> consumers;
+    for (int k = 0; k < 2; ++k) {
+        consumers.emplace_back([&]() {
+            int value = 0;
+            while (sharded.pop(value) == asyncpp::result_code::SUCCEED) {
+                sum += value;
+                ++popped;
+            }
+        });
+    }
+    auto t0 = std::chrono::steady_clock::now();
+    std::vector<std::thread> producers;
+    for (int k = 0; k < 4; ++k) {
+        producers.emplace_back([&, k]() {
+            asyncpp::numa::run_on_node(k % nodes);
+            for (int i = 0; i < items / 4; ++i) {
+                sharded.push(1);
+            }
+        });
+    }
+    for (auto & t : producers) {
+        t.join();
+    }
+    while (popped.load() < items) {
+        std::this_thread::yield();
+    }
+    auto d = std::chrono::steady_clock::now() - t0;
+    sharded.disable();
+    for (auto & t : consumers) {
+        t.join();
+    }
+    printf("sharded over %u shards: %d items, sum %ld, %.0f items/s\n",
+        sharded.get_shard_count(), popped.load(), sum.load(),
+        items / std::chrono::duration<double>(d).count());
+}
+
+void test_conflating_queue() {
+    const uint32_t keys = 64;
+    const uint64_t updates = 1000000;
+    asyncpp::conflating_queue<uint32_t, uint64_t> queue;
+    queue.enable(keys);
+    //a slow consumer, every value must be newer than the last one seen
+    std::vector<uint64_t> latest(keys, 0);
+    uint32_t popped = 0;
+    uint32_t errors = 0;
+    std::thread consumer([&]() {
+        uint32_t key = 0;
+        uint64_t value = 0;
+        while (queue.pop(key, value) == asyncpp::result_code::SUCCEED) {
+            if (key >= keys || value <= latest[key]) {
+                ++errors;
+            } else {
+                latest[key] = value;
+            }
+            ++popped;
+            if (popped % 64 == 0) {
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+            }
+        }
+    });
+    auto t0 = std::chrono::steady_clock::now();
+    uint32_t peak = 0;
+    for (uint64_t seq = 1; seq <= updates; ++seq) {
+        queue.push((uint32_t)(seq * 7 % keys), seq);
+        peak = std::max(peak, queue.get_size());
+    }
+    auto d = std::chrono::steady_clock::now() - t0;
+    while (queue.get_size() > 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    queue.disable();
+    consumer.join();
+    uint32_t fresh = 0;
+    for (uint32_t k = 0; k < keys; ++k) {
+        //the last update of each key is among the final keys pushes
+        fresh += latest[k] > updates - keys;
+    }
+    printf("conflating: %lu updates in %ldms, %u popped, %lu conflated, peak %u of %u keys, %u/%u fresh, %u errors\n",
+        updates, (long)std::chrono::duration_cast<std::chrono::milliseconds>(d).count(),
+        popped, queue.get_conflated(), peak, keys, fresh, keys, errors);
+
+    //merged updates keep the key's place in line
+    asyncpp::conflating_queue<std::string, int> merged;
+    merged.enable(4);
+    merged.set_merge([](int & queued, int && incoming) { queued += incoming; });
+    merged.push("a", 1);
+    merged.push("b", 10);
+    merged.push("a", 2);
+    merged.push("c", 100);
+    merged.push("b", 20);
+    std::string key;
+    int value = 0;
+    printf("merged:");
+    while (merged.try_pop(key, value) == asyncpp::result_code::SUCCEED) {
+        printf(" %s=%d", key.c_str(), value);
+    }
+    printf("\n");
+    merged.push("x", 1);
+    merged.push("y", 1);
+    merged.push("z", 1);
+    merged.push("w", 1);
+    auto res = merged.push("v", 1, asyncpp::timeout(std::chrono::milliseconds(10)));
+    printf("push to a full queue: %d, conflating into it: %d\n", res, merged.try_push("x", 1));
+    std::thread blocked([&]() {
+        printf("blocked push after disable: %d\n", merged.push("v", 1));
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    merged.disable();
+    blocked.join();
+    printf("pop after disable: %d\n", merged.pop(key, value));
+}
+
+template<typename _Queue>
+void pop_batch_with(const char * name, bool batched) {
+    const uint32_t items = 1000000;
+    _Queue queue;
+    queue.enable(4096);
+    uint32_t popped = 0;
+    uint32_t errors = 0;
+    uint32_t calls = 0;
+    std::thread consumer([&]() {
+        std::vector<int> batch;
+        int item = 0;
+        while (popped < items) {
+            ++calls;
+            if (!batched) {
+                if (queue.pop(item) != asyncpp::result_code::SUCCEED) {
+                    break;
+                }
+                errors += item != (int)popped++;
+                continue;
+            }
+            batch.clear();
+            auto res = queue.pop_batch(batch, 64, 1024, asyncpp::timeout(std::chrono::milliseconds(1)));
+            if (res == asyncpp::result_code::UNAVAILABLE_OR_TIMEOUT) {
+                continue;
+            }
+            if (res != asyncpp::result_code::SUCCEED) {
+                break;
+            }
+            for (int v : batch) {
+                errors += v != (int)popped++;
+            }
+        }
+    });
+    auto t0 = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < items; ++i) {
+        queue.push((int)i);
+    }
+    consumer.join();
+    auto d = std::chrono::steady_clock::now() - t0;
+    printf("%s %s: %u items in %ldms, %u calls, %u errors\n", name, batched ? "pop_batch" : "pop",
+        popped, (long)std::chrono::duration_cast<std::chrono::milliseconds>(d).count(), calls, errors);
+}
+
+void test_pop_batch() {
+    pop_batch_with<asyncpp::adv_queue<int>>("adv_queue", false);
+    pop_batch_with<asyncpp::adv_queue<int>>("adv_queue", true);
+    pop_batch_with<asyncpp::basic_queue<int>>("basic_queue", false);
+    pop_batch_with<asyncpp::basic_queue<int>>("basic_queue", true);
+    pop_batch_with<asyncpp::adv_queue<int, true, asyncpp::flat_ring_queue<int, 4097>>>("shared adv_queue", true);
+
+    //a short batch once the linger is over, nothing at all times out
+    asyncpp::adv_queue<int> queue;
+    queue.enable(16);
+    queue.push(1);
+    queue.push(2);
+    queue.push(3);
+    std::vector<int> batch;
+    auto t0 = std::chrono::steady_clock::now();
+    auto res = queue.pop_batch(batch, 10, 16, asyncpp::timeout(std::chrono::milliseconds(20)));
+    auto d = std::chrono::steady_clock::now() - t0;
+    printf("linger: res=%d, %zu items after %ldms\n", res, batch.size(),
+        (long)std::chrono::duration_cast<std::chrono::milliseconds>(d).count());
+    res = queue.pop_batch(batch, 1, 16, asyncpp::timeout(std::chrono::milliseconds(5)));
+    printf("empty: res=%d, bad bounds: res=%d\n", res, queue.pop_batch(batch, 4, 2));
+    queue.push(4);
+    queue.push(5);
+    batch.clear();
+    res = queue.try_pop_batch(batch, 16);
+    asyncpp::result_code empty = queue.try_pop_batch(batch, 16);
+    asyncpp::basic_queue<int> basic;
+    basic.enable(16);
+    basic.push(6);
+    asyncpp::result_code basic_res = basic.try_pop_batch(batch, 16);
+    printf("try_pop_batch: res=%d, %zu items, empty: res=%d, basic: res=%d\n",
+        res, batch.size(), empty, basic_res);
+    std::thread blocked([&]() {
+        printf("blocked pop_batch after disable: %d\n", queue.pop_batch(batch, 1, 16));
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    queue.disable();
+    blocked.join();
+}
+
+void test_dispatcher(int qc) {
+    const uint32_t per_queue = 2000;
+    std::vector<std::unique_ptr<asyncpp::adv_queue<uint32_t>>> queues;
+    //per queue: the next value expected and whether a handler runs
+    std::vector<uint32_t> expected(qc, 0);
+    std::vector<std::atomic<bool>> running(qc);
+    std::atomic<uint32_t> errors = 0;
+    std::atomic<uint32_t> handled = 0;
+    asyncpp::dispatcher dispatcher;
+    dispatcher.start(4, 64, 16);
+    for (int q = 0; q < qc; ++q) {
+        queues.emplace_back(new asyncpp::adv_queue<uint32_t>());
+        queues[q]->enable(256);
+        dispatcher.add(*queues[q], [&, q](uint32_t && v) {
+            if (running[q].exchange(true)) {
+                ++errors;
+            }
+            if (v != expected[q]++) {
+                ++errors;
+            }
+            ++handled;
+            running[q] = false;
+        });
+    }
+    auto t0 = std::chrono::steady_clock::now();
+    std::vector<std::thread> producers;
+    for (int k = 0; k < 4; ++k) {
+        producers.emplace_back([&, k]() {
+            for (uint32_t i = 0; i < per_queue; ++i) {
+                for (int q = k; q < qc; q += 4) {
+                    queues[q]->push(i);
+                }
+            }
+        });
+    }
+    for (auto & t : producers) {
+        t.join();
+    }
+    while (handled.load() < per_queue * qc) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    auto d = std::chrono::steady_clock::now() - t0;
+    printf("dispatcher: %d queues on 4 workers, %u items in %ldms, %u errors\n", qc, handled.load(),
+        (long)std::chrono::duration_cast<std::chrono::milliseconds>(d).count(), errors.load());
+
+    //a removed handler sees nothing more
+    asyncpp::adv_queue<uint32_t> late;
+    late.enable(16);
+    late.push(1);
+    std::atomic<uint32_t> seen = 0;
+    asyncpp::dispatcher::handle h = nullptr;
+    dispatcher.add(late, [&](uint32_t &&) { ++seen; }, &h);
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    printf("queued before add: %u seen, remove: %d\n", seen.load(), dispatcher.remove(h));
+    late.push(2);
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    printf("after remove: %u seen, %zu left queued\n", seen.load(), (size_t)late.get_size());
+    dispatcher.stop();
+}
+
+void test_object_pool(int pc) {
+    using pool_t = asyncpp::object_pool<std::vector<char>, 1024>;
+    const uint32_t per_producer = 200000;
+    std::unique_ptr<pool_t> pool(new pool_t());
+    asyncpp::adv_queue<pool_t::handle> queue;
+    queue.enable(256);
+    std::atomic<uint32_t> errors = 0;
+    std::atomic<uint32_t> misses = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    std::vector<std::thread> producers;
+    for (int k = 0; k < pc; ++k) {
+        producers.emplace_back([&, k]() {
+            for (uint32_t i = 0; i < per_producer; ++i) {
+                pool_t::handle h;
+                while (pool->acquire(h) != asyncpp::result_code::SUCCEED) {
+                    ++misses;
+                    std::this_thread::yield();
+                }
+                //recycled buffers keep their capacity
+                h->resize(256);
+                h->front() = (char)k;
+                h->back() = (char)i;
+                queue.push(std::move(h));
+            }
+            pool->flush();
+        });
+    }
+    std::thread consumer([&]() {
+        pool_t::handle h;
+        for (uint32_t i = 0; i < per_producer * pc; ++i) {
+            queue.pop(h);
+            if (h->size() != 256 || h->front() >= pc) {
+                ++errors;
+            }
+            //the last one is given back by the next pop
+        }
+        h.reset();
+        pool->flush();
+    });
+    for (auto & t : producers) {
+        t.join();
+    }
+    consumer.join();
+    auto d = std::chrono::steady_clock::now() - t0;
+    //everything is back: one thread gets every object again
+    std::vector<pool_t::handle> all(pool->get_capacity());
+    uint32_t got = 0;
+    for (auto & h : all) {
+        got += pool->acquire(h) == asyncpp::result_code::SUCCEED;
+    }
+    pool_t::handle extra;
+    printf("object_pool: %u items in %ldms, %u errors, %u misses, %u of %u back, one more: %d\n",
+        per_producer * pc, (long)std::chrono::duration_cast<std::chrono::milliseconds>(d).count(),
+        errors.load(), misses.load(), got, pool->get_capacity(), pool->acquire(extra));
+    all.clear();
+
+    //the same traffic with a fresh vector per item
+    asyncpp::adv_queue<std::vector<char>> plain;
+    plain.enable(256);
+    t0 = std::chrono::steady_clock::now();
+    producers.clear();
+    for (int k = 0; k < pc; ++k) {
+        producers.emplace_back([&]() {
+            for (uint32_t i = 0; i < per_producer; ++i) {
+                plain.push(std::vector<char>(256));
+            }
+        });
+    }
+    std::vector<char> v;
+    for (uint32_t i = 0; i < per_producer * pc; ++i) {
+        plain.pop(v);
+    }
+    for (auto & t : producers) {
+        t.join();
+    }
+    d = std::chrono::steady_clock::now() - t0;
+    printf("allocated per item: %u items in %ldms\n", per_producer * pc,
+        (long)std::chrono::duration_cast<std::chrono::milliseconds>(d).count());
+}
+
 void test_fill_and_drain() {
     asyncpp::adv_queue<int> queue;
     queue.enable(20);
@@ -177,21 +1666,21 @@ void test_capacity_change() {
         }
     });
     queue.fill();
-    printf("filled: %u/%u\n", queue.get_size(), queue.get_capacity());
+    printf("filled: %u/%lu\n", queue.get_size(), (unsigned long)queue.get_capacity());
     queue.drain();
-    printf("drained: %u/%u\n", queue.get_size(), queue.get_capacity());
+    printf("drained: %u/%lu\n", queue.get_size(), (unsigned long)queue.get_capacity());
     printf("enlarge capacity\n");
     queue.change_capacity(20);
     queue.fill();
-    printf("filled: %u/%u\n", queue.get_size(), queue.get_capacity());
+    printf("filled: %u/%lu\n", queue.get_size(), (unsigned long)queue.get_capacity());
     queue.drain();
-    printf("drained: %u/%u\n", queue.get_size(), queue.get_capacity());
+    printf("drained: %u/%lu\n", queue.get_size(), (unsigned long)queue.get_capacity());
     printf("shrink capacity\n");
     queue.change_capacity(7);
     queue.fill();
-    printf("filled: %u/%u\n", queue.get_size(), queue.get_capacity());
+    printf("filled: %u/%lu\n", queue.get_size(), (unsigned long)queue.get_capacity());
     queue.drain();
-    printf("drained: %u/%u\n", queue.get_size(), queue.get_capacity());
+    printf("drained: %u/%lu\n", queue.get_size(), (unsigned long)queue.get_capacity());
     printf("quitting\n");
     queue.disable();
     producer.join();
@@ -257,6 +1746,58 @@ void test_sync_queue() {
     printf("both joined\n");
 }
 
+void test_sync_queue_mpmc(int pc, int cc) {
+    const uint32_t per_producer = 20000;
+    asyncpp::sync_queue<uint32_t> queue;
+    queue.enable();
+    std::atomic<uint64_t> sum = 0;
+    std::atomic<uint32_t> received = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    std::vector<std::thread> producers;
+    std::vector<std::thread> consumers;
+    for (int k = 0; k < cc; ++k) {
+        consumers.emplace_back([&]() {
+            uint32_t value = 0;
+            while (queue.pop(value) == asyncpp::result_code::SUCCEED) {
+                sum += value;
+                ++received;
+            }
+        });
+    }
+    for (int k = 0; k < pc; ++k) {
+        producers.emplace_back([&]() {
+            for (uint32_t i = 1; i <= per_producer; ++i) {
+                if (queue.push(i) != asyncpp::result_code::SUCCEED) {
+                    break;
+                }
+            }
+        });
+    }
+    for (auto & p : producers) {
+        p.join();
+    }
+    //every push has been handed over once it returned
+    queue.disable();
+    for (auto & c : consumers) {
+        c.join();
+    }
+    auto d = std::chrono::steady_clock::now() - t0;
+    uint64_t expected = (uint64_t)pc * per_producer * (per_producer + 1) / 2;
+    printf("sync_queue pc=%d cc=%d cost=%ldms received=%u sum %s\n", pc, cc,
+        std::chrono::duration_cast<std::chrono::milliseconds>(d).count(),
+        received.load(), sum == expected ? "ok" : "mismatch"
+    );
+    queue.enable();
+    auto t1 = std::chrono::steady_clock::now();
+    auto res = queue.push(1, std::chrono::milliseconds(200));
+    auto dur = std::chrono::steady_clock::now() - t1;
+    uint32_t value = 0;
+    printf("unmatched push res=%d dur=%ldms, try_pop res=%d\n", res,
+        std::chrono::duration_cast<std::chrono::milliseconds>(dur).count(),
+        queue.try_pop(value));
+    queue.disable();
+}
+
 void test_barrier() {
     uint32_t count = 5;
     std::vector<std::thread> threads;
@@ -305,6 +1846,57 @@ void test_thread_prio()
     printf("done\n");
 }
 
+template<template<bool> typename _Policy>
+void test_rt_jitter_with(const char * name, bool prepare) {
+    const int samples = 3000;
+    using item_t = asyncpp::time_point;
+    asyncpp::adv_queue<item_t, false, asyncpp::flat_ring_queue<item_t, 65>, _Policy> queue;
+    queue.enable(64);
+    if (prepare) {
+        asyncpp::realtime::lock_object(queue);
+    }
+    std::vector<int64_t> latencies;
+    latencies.reserve(samples);
+    std::atomic<bool> exit = false;
+    auto consumer = std::thread([&]() {
+        if (prepare) {
+            asyncpp::this_thread::make_fifo(80);
+            asyncpp::realtime::prefault_stack(256 * 1024);
+        }
+        item_t sent;
+        while (queue.pop(sent) == asyncpp::result_code::SUCCEED) {
+            latencies.push_back((asyncpp::clock::now() - sent).count());
+        }
+    });
+    //keeps hitting the same semaphore lock at normal priority
+    auto noise = std::thread([&]() {
+        uint64_t spins = 0;
+        while (!exit) {
+            spins += queue.ready() ? 1 : 0;
+        }
+    });
+    for (int i = 0; i < samples; ++i) {
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+        queue.push(asyncpp::clock::now());
+    }
+    queue.drain();
+    queue.disable();
+    exit = true;
+    consumer.join();
+    noise.join();
+    std::sort(latencies.begin(), latencies.end());
+    auto at = [&](double q) {
+        return latencies.empty() ? 0 : latencies[(size_t)(q * (latencies.size() - 1))] / 1000;
+    };
+    printf("%s: samples=%zu p50=%ldus p99=%ldus max=%ldus\n", name,
+        latencies.size(), at(0.5), at(0.99), at(1.0));
+}
+
+void test_rt_jitter() {
+    test_rt_jitter_with<asyncpp::sync_policy>("default", false);
+    test_rt_jitter_with<asyncpp::rt_policy>("realtime", true);
+}
+
 /*
 template<typename ..._Ts>
 struct Sizeof;
@@ -351,6 +1943,10 @@ void print2(const asyncpp::Seq<_Values...> &) {
 
 
 void test_inter_proc();
+void test_inter_proc_triple_buffer();
+void test_inter_proc_byte_ring();
+void test_inter_proc_segment();
+void test_inter_proc_pool();
 int main(int argc, const char * argv[])
 {
     printf("%d %d\n", Sizeof<int, bool>::value, Sizeof<>::value);
@@ -358,7 +1954,12 @@ int main(int argc, const char * argv[])
     r.print();
     print2(asyncpp::Range2<2, 8>::seq{});
     //test_inter_proc();
+    //test_inter_proc_triple_buffer();
+    //test_inter_proc_byte_ring();
+    //test_inter_proc_segment();
+    //test_inter_proc_pool();
     //test_sync_queue();
+    //test_sync_queue_mpmc(2, 2);
     //test_nonblock_and_timeout();
     //test_fill_and_drain();
     //test_capacity_change();
@@ -366,7 +1967,31 @@ int main(int argc, const char * argv[])
     /*while (true) {
         test_queue(2, 1);
     }*/
+    //test_multicast_ring(4);
+    //test_select();
+    //test_thundering_herd(32);
+    //test_block_behind_value_waiter();
+    //test_sojourn();
+    //test_codel();
+    //test_capacity_controller();
+    //test_shrink_keeps_block();
+    //test_pipeline();
+    //test_future();
+    //test_parallel_for(4);
+    //test_lock_policies(2);
+    //test_byte_budget();
+    //test_byte_queue();
+    //test_byte_fill_timeout();
+    //test_byte_ring_timeout();
+    //test_file_io();
+    //test_event_count();
+    //test_numa();
+    //test_conflating_queue();
+    //test_pop_batch();
+    //test_dispatcher(200);
+    //test_object_pool(4);
     //test_thread_prio();
+    //test_rt_jitter();
     return 0;
 }
 